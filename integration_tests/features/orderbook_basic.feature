@@ -79,3 +79,140 @@ Feature: Order Book receives snapshot
     And Bids in the snapshot does not contains level 3988.50
     And Asks in the snapshot contains level 3988.63 with size 14
     And Asks in the snapshot does not contains level 3988.60
+
+
+  @BucketTest
+  Scenario: Order Book serves aggregated price bucket views
+    Given Order Book Simulator is running
+    And Order Book is running
+    And Set following snapshot in simulator
+      """
+      {
+        "sequence": "16",
+        "asks":[
+          ["3988.62","8"],
+          ["3988.61","32"],
+          ["3988.60","47"],
+          ["3988.59","3"]
+        ],
+        "bids":[
+          ["3988.51","56"],
+          ["3988.50","15"],
+          ["3988.49","100"],
+          ["3988.48","10"]
+        ]
+      }
+      """
+    And Add bid at level 3988.57 and size 20
+    And Remove bid from level 3988.50
+    And Simulator sends incremental update to Order Book
+    And Simulator process any pending snapshot request from Order Book
+    And Verify Order Book sequence number is 18
+    When Get price bucket view of size 1 from Order Book
+    Then Bids in the bucket view contains bucket 3988 with size 186
+    And Asks in the bucket view contains bucket 3989 with size 90
+    When Get price bucket view of size 0.1 from Order Book
+    Then Bids in the bucket view contains bucket 3988.5 with size 76
+    And Bids in the bucket view contains bucket 3988.4 with size 110
+    And Asks in the bucket view contains bucket 3988.6 with size 50
+
+
+  @ChecksumTest
+  Scenario: Order Book serves the checksum of its top levels
+    Given Order Book Simulator is running
+    And Order Book is running
+    And Set following snapshot in simulator
+      """
+      {
+        "sequence": "16",
+        "asks":[
+          ["3988.62","8"],
+          ["3988.61","32"],
+          ["3988.60","47"],
+          ["3988.59","3"]
+        ],
+        "bids":[
+          ["3988.51","56"],
+          ["3988.50","15"],
+          ["3988.49","100"],
+          ["3988.48","10"]
+        ]
+      }
+      """
+    And Add bid at level 3988.57 and size 20
+    And Remove bid from level 3988.50
+    And Simulator sends incremental update to Order Book
+    And Simulator process any pending snapshot request from Order Book
+    When Get snapshot from Order Book
+    Then Verify Order Book sequence number is 18
+    And Checksum in the snapshot matches its top 25 levels
+
+
+  @TopOfBookTest
+  Scenario: Order Book serves its best bid and ask
+    Given Order Book Simulator is running
+    And Order Book is running
+    And Set following snapshot in simulator
+      """
+      {
+        "sequence": "16",
+        "asks":[
+          ["3988.62","8"],
+          ["3988.61","32"],
+          ["3988.60","47"],
+          ["3988.59","3"]
+        ],
+        "bids":[
+          ["3988.51","56"],
+          ["3988.50","15"],
+          ["3988.49","100"],
+          ["3988.48","10"]
+        ]
+      }
+      """
+    And Add bid at level 3988.57 and size 20
+    And Remove ask from level 3988.59
+    And Simulator sends incremental update to Order Book
+    And Simulator process any pending snapshot request from Order Book
+    And Verify Order Book sequence number is 18
+    When Get top of book from Order Book
+    Then Best bid is 3988.57 with size 20
+    And Best ask is 3988.60 with size 47
+
+
+  @FeedAdapterTest
+  Scenario Outline: Order Book parses the <feed> feed schema
+    Given Order Book Simulator for venue <feed> is running
+    And Order Book for feed <feed> is running
+    And Set following snapshot in simulator
+      """
+      {
+        "sequence": "16",
+        "asks":[
+          ["3988.62","8"],
+          ["3988.61","32"],
+          ["3988.60","47"],
+          ["3988.59","3"]
+        ],
+        "bids":[
+          ["3988.51","56"],
+          ["3988.50","15"],
+          ["3988.49","100"],
+          ["3988.48","10"]
+        ]
+      }
+      """
+    And Add bid at level 3988.57 and size 20
+    And Remove bid from level 3988.50
+    And Simulator sends incremental update to Order Book
+    And Simulator process any pending snapshot request from Order Book
+    When Get snapshot from Order Book
+    Then Verify Order Book sequence number is 18
+    And Bids in the snapshot contains level 3988.57 with size 20
+    And Bids in the snapshot does not contains level 3988.50
+
+    Examples:
+      | feed            |
+      | kucoin          |
+      | binance         |
+      | binance-futures |
@@ -5,18 +5,21 @@ import os
 import time
 
 class OrderBook:
-    def __init__(self, simulatorHost='127.0.0.1', simulatorPort=40000, httpServerPort=48080):
+    def __init__(self, simulatorHost='127.0.0.1', simulatorPort=40000, httpServerPort=48080, feed='kucoin'):
         self.m_simulatorHost = simulatorHost
         self.m_simulatorPort = simulatorPort
         self.m_httpServerHost = simulatorHost
         self.m_httpServerPort = httpServerPort
 
         self.snapshot = None
+        self.buckets = None
+        self.topOfBook = None
         args = ['--host', simulatorHost]
         args += ['--port', str(simulatorPort)]
         args += ['--http_server_host', str(self.m_httpServerHost)]
         args += ['--http_server_port', str(httpServerPort)]
         args += ['--reconnect_delay', '200']
+        args += ['--feed', feed]
         cmd = [os.getenv("BUILD_DIR", "") + "/src/OrderBook"] + args
         logging.debug(f"Running command: {cmd}")
         loggingLevel = logging.getLevelName(logging.getLogger().getEffectiveLevel())
@@ -44,4 +47,12 @@ class OrderBook:
 
     def getSnapshot(self):
         self.snapshot = utils.httpGet(self.m_httpServerHost, self.m_httpServerPort, "/snapshot.api")
-        return self.snapshot
\ No newline at end of file
+        return self.snapshot
+
+    def getBuckets(self, bucketSize):
+        self.buckets = utils.httpGet(self.m_httpServerHost, self.m_httpServerPort, f"/buckets.api?bucket={bucketSize}")
+        return self.buckets
+
+    def getTopOfBook(self):
+        self.topOfBook = utils.httpGet(self.m_httpServerHost, self.m_httpServerPort, "/bbo.api")
+        return self.topOfBook
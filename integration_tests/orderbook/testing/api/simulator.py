@@ -5,13 +5,14 @@ import os
 import json
 
 class Simulator:
-    def __init__(self, host='127.0.0.1', port=40000):
+    def __init__(self, host='127.0.0.1', port=40000, venue='kucoin'):
         self.m_host = host
         self.m_port = port
         loggingLevel = logging.getLevelName(logging.getLogger().getEffectiveLevel())
         args = ['--host', host]
         args += ['--port', str(port)]
         args += ['--passive', 'True']
+        args += ['--venue', venue]
         args += ['--log-level', loggingLevel]
         cmd = [os.getenv("BUILD_DIR", "") + "/simulator/order_book_simulator.py"] + args
         logging.debug(f"Running command: {cmd}")
@@ -1,6 +1,8 @@
 from behave import step
 from orderbook.testing.api  import simulator, orderbook
 import logging
+import zlib
+from decimal import Decimal
 
 SIMULATOR_BASE_PORT_NUMBER = 20000
 ORDERBOOK_BASE_PORT_NUMBER = 22000
@@ -12,6 +14,12 @@ def step_impl(context):
     context.simulators["main"] = simulator.Simulator(port=port)
     context.simulators["main"].waitForRunningState()
 
+@step('Order Book Simulator for venue {venue} is running')
+def step_impl(context, venue):
+    port = SIMULATOR_BASE_PORT_NUMBER
+    context.simulators["main"] = simulator.Simulator(port=port, venue=venue)
+    context.simulators["main"].waitForRunningState()
+
 @step('Order Book is running')
 @step('Run an Order Book')
 def step_impl(context):
@@ -20,6 +28,13 @@ def step_impl(context):
     context.orderbooks["main"] = orderbook.OrderBook(simulatorPort=simulatorPort, httpServerPort=orderBookHttpServerPort)
     context.orderbooks["main"].waitForRunningState()
 
+@step('Order Book for feed {feed} is running')
+def step_impl(context, feed):
+    simulatorPort = SIMULATOR_BASE_PORT_NUMBER
+    orderBookHttpServerPort = ORDERBOOK_BASE_PORT_NUMBER
+    context.orderbooks["main"] = orderbook.OrderBook(simulatorPort=simulatorPort, httpServerPort=orderBookHttpServerPort, feed=feed)
+    context.orderbooks["main"].waitForRunningState()
+
 @step('Set following snapshot in simulator')
 def step_impl(context):
     context.simulators["main"].setSnapshot(context.text)
@@ -81,4 +96,43 @@ def step_impl(context, bidOrAsk, price):
     levels = context.orderbooks["main"].snapshot["bids"] if isBid else context.orderbooks["main"].snapshot["asks"]
     for priceAndSize in levels:
         if float(priceAndSize[0]) == float(price):
-            assert False, f"Was not expecting {bidOrAsk} level {price} to exist"
\ No newline at end of file
+            assert False, f"Was not expecting {bidOrAsk} level {price} to exist"
+
+@step('Get price bucket view of size {bucketSize} from Order Book')
+def step_impl(context, bucketSize):
+    context.orderbooks["main"].getBuckets(bucketSize)
+    logging.debug(f"buckets: {context.orderbooks["main"].buckets}")
+
+@step('{bidOrAsk} in the bucket view contains bucket {price} with size {size}')
+def step_impl(context, bidOrAsk, price, size):
+    isBid = bidOrAsk.upper() == "BIDS"
+    levels = context.orderbooks["main"].buckets["bids"] if isBid else context.orderbooks["main"].buckets["asks"]
+    for bucket in levels:
+        if float(bucket[0]) == float(price):
+            assert float(bucket[1]) == float(size), f"size at {bidOrAsk} bucket {price} is {bucket[1]}, was expecting {size}"
+            return
+    assert False, f"{bidOrAsk} bucket {price} doesn't exist"
+
+@step('Get top of book from Order Book')
+def step_impl(context):
+    context.orderbooks["main"].getTopOfBook()
+    logging.debug(f"top of book: {context.orderbooks["main"].topOfBook}")
+
+@step('Best {bidOrAsk} is {price} with size {size}')
+def step_impl(context, bidOrAsk, price, size):
+    level = context.orderbooks["main"].topOfBook[bidOrAsk.lower()]
+    assert level, f"there is no best {bidOrAsk}"
+    assert float(level[0]) == float(price), f"best {bidOrAsk} is at {level[0]}, was expecting {price}"
+    assert float(level[1]) == float(size), f"size of best {bidOrAsk} is {level[1]}, was expecting {size}"
+
+@step('Checksum in the snapshot matches its top {depth} levels')
+def step_impl(context, depth):
+    snapshot = context.orderbooks["main"].snapshot
+    shortest = lambda number: format(Decimal(number).normalize(), 'f')
+    fields = []
+    for i in range(int(depth)):
+        for side in ("bids", "asks"):
+            if i < len(snapshot[side]):
+                fields += [shortest(snapshot[side][i][0]), shortest(snapshot[side][i][1])]
+    expected = zlib.crc32(":".join(fields).encode())
+    assert snapshot.get("checksum") == expected, f"checksum is {snapshot.get('checksum')}, was expecting {expected}"
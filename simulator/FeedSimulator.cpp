@@ -0,0 +1,561 @@
+#include "FeedSimulator.h"
+
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/signal_set.hpp>
+#include <boost/beast/core.hpp>
+#include <boost/beast/http.hpp>
+#include <boost/beast/websocket.hpp>
+#include <charconv>
+#include <cmath>
+#include <csignal>
+#include <format>
+#include <fstream>
+#include <nlohmann/json.hpp>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+
+#include "BookChecksum.hpp"
+#include "logging.h"
+
+namespace beast = boost::beast;
+namespace http = beast::http;
+namespace websocket = beast::websocket;
+namespace asio = boost::asio;
+using tcp = asio::ip::tcp;
+
+namespace {
+
+const int SIZE_DECIMALS = 8;
+// how often websocket sessions are checked for frames sent by the client
+const auto SESSION_POLL_INTERVAL = std::chrono::milliseconds(10);
+// a stalled generator catches up with at most this much of the rate
+const double MAX_RATE_CREDIT_SECONDS = 0.01;
+
+std::vector<std::int64_t> loadPricePath(const FeedSimulatorOptions& options) {
+  std::ifstream simDataFile(options.simDataPath);
+  if (!simDataFile) {
+    throw std::runtime_error(
+        std::format("Cannot open sim data '{}'", options.simDataPath));
+  }
+  auto closePrices =
+      nlohmann::json::parse(simDataFile)["close"].get<std::vector<double>>();
+  auto ticksPerUnit = std::pow(10.0, options.priceDecimals);
+  std::vector<std::int64_t> pricePath;
+  pricePath.reserve(std::size(closePrices));
+  for (auto closePrice : closePrices) {
+    pricePath.push_back(std::llround(closePrice * ticksPerUnit));
+  }
+  return pricePath;
+}
+
+// Appends `value` / 10^decimals with exactly `decimals` decimal places.
+void appendDecimal(std::string& output, std::int64_t value, int decimals) {
+  char digits[32];
+  auto end = std::to_chars(std::begin(digits), std::end(digits),
+                           value < 0 ? -value : value)
+                 .ptr;
+  std::string_view text(digits, end);
+  if (value < 0) {
+    output.push_back('-');
+  }
+  if (std::ssize(text) <= decimals) {
+    output.append("0.");
+    output.append(decimals - std::size(text), '0');
+    output.append(text);
+    return;
+  }
+  output.append(text.substr(0, std::size(text) - decimals));
+  if (decimals > 0) {
+    output.push_back('.');
+    output.append(text.substr(std::size(text) - decimals));
+  }
+}
+
+void appendInteger(std::string& output, std::uint64_t value) {
+  char digits[32];
+  auto end = std::to_chars(std::begin(digits), std::end(digits), value).ptr;
+  output.append(digits, end);
+}
+
+std::int64_t millisecondsSinceEpoch() {
+  return std::chrono::duration_cast<std::chrono::milliseconds>(
+             std::chrono::system_clock::now().time_since_epoch())
+      .count();
+}
+
+}  // namespace
+
+struct FeedSimulator::Network {
+  asio::io_context ioc;
+  tcp::acceptor acceptor{ioc};
+  asio::signal_set signals{ioc, SIGINT, SIGTERM};
+};
+
+class WebSocketSession {
+  websocket::stream<tcp::socket> m_stream;
+  std::string m_remote;
+  beast::flat_buffer m_readBuffer;
+
+ public:
+  explicit WebSocketSession(tcp::socket&& socket)
+      : m_stream{std::move(socket)},
+        m_remote{std::format(
+            "{}:{}",
+            m_stream.next_layer().remote_endpoint().address().to_string(),
+            m_stream.next_layer().remote_endpoint().port())} {}
+
+  void accept(const http::request<http::string_body>& request, bool deflate) {
+    if (deflate) {
+      websocket::permessage_deflate permessageDeflate;
+      permessageDeflate.server_enable = true;
+      m_stream.set_option(permessageDeflate);
+    }
+    m_stream.accept(request);
+    m_stream.text(true);
+  }
+
+  // All calls below come from the generator thread only.
+  void write(const std::string& frame) {
+    m_stream.write(asio::buffer(frame));
+  }
+
+  // Reads frames the client already sent, e.g. its subscription, so close
+  // frames get answered.
+  void poll() {
+    while (m_stream.next_layer().available() > 0) {
+      m_stream.read(m_readBuffer);
+      m_readBuffer.clear();
+    }
+  }
+
+  void close() {
+    beast::error_code ec;
+    m_stream.next_layer().shutdown(tcp::socket::shutdown_both, ec);
+    m_stream.next_layer().close(ec);
+  }
+
+  const std::string& getRemote() const { return m_remote; }
+};
+
+FeedSimulator::FeedSimulator(FeedSimulatorOptions options)
+    : m_options{std::move(options)},
+      m_network{std::make_unique<Network>()},
+      m_orderBook{loadPricePath(m_options), m_options.stepsPerPathPoint,
+                  m_options.maxLevels, m_options.seed} {
+  if (m_options.l3) {
+    m_orderQueues.emplace(m_orderBook.getBids(), m_orderBook.getAsks(),
+                          m_orderBook.getSequence(), m_options.seed);
+  }
+  tcp::resolver resolver(m_network->ioc);
+  tcp::endpoint endpoint =
+      *resolver.resolve(m_options.host, m_options.port).begin();
+  m_network->acceptor.open(endpoint.protocol());
+  m_network->acceptor.set_option(tcp::acceptor::reuse_address(true));
+  m_network->acceptor.bind(endpoint);
+  m_network->acceptor.listen();
+  m_network->signals.async_wait([this](beast::error_code ec, int signal) {
+    LOG_INFO(std::format("Received signal: {}, ec: {}", signal, ec.message()));
+    m_stopFlag = true;
+    m_network->ioc.stop();
+  });
+}
+
+FeedSimulator::~FeedSimulator() = default;
+
+void FeedSimulator::run() {
+  LOG_INFO("Feed simulator listening on " << m_options.host << ":"
+                                          << m_options.port << ", "
+                                          << (m_options.rate > 0
+                                                  ? std::format(
+                                                        "{} level changes/s",
+                                                        m_options.rate)
+                                                  : std::string("flat out")));
+  accept();
+  std::jthread networkThread([this]() { m_network->ioc.run(); });
+  generate();
+  m_stopFlag = true;
+  m_network->ioc.stop();
+}
+
+void FeedSimulator::accept() {
+  m_network->acceptor.async_accept([this](beast::error_code ec,
+                                          tcp::socket socket) {
+    if (ec) {
+      LOG_ERROR("accept failed: " << ec.message());
+      return;
+    }
+    try {
+      socket.set_option(tcp::no_delay(true));
+      beast::flat_buffer buffer;
+      http::request<http::string_body> request;
+      http::read(socket, buffer, request);
+      if (websocket::is_upgrade(request)) {
+        auto session = std::make_shared<WebSocketSession>(std::move(socket));
+        session->accept(request, m_options.deflate);
+        LOG_INFO("websocket session from " << session->getRemote());
+        std::lock_guard lock(m_sessionsMutex);
+        m_sessions.push_back(std::move(session));
+      } else {
+        http::response<http::string_body> response;
+        response.version(request.version());
+        response.keep_alive(false);
+        if (request.target().starts_with("/snapshot")) {
+          std::this_thread::sleep_for(m_options.snapshotDelay);
+          response.result(http::status::ok);
+          response.set(http::field::content_type, "application/json");
+          response.body() = serializeSnapshot();
+        } else if (m_orderQueues && request.target().starts_with(
+                                        "/api/v3/market/orderbook/level3")) {
+          std::this_thread::sleep_for(m_options.snapshotDelay);
+          response.result(http::status::ok);
+          response.set(http::field::content_type, "application/json");
+          response.body() = serializeOrderSnapshot();
+        } else {
+          response.result(http::status::not_found);
+        }
+        response.prepare_payload();
+        http::write(socket, response);
+        socket.shutdown(tcp::socket::shutdown_both, ec);
+      }
+    } catch (const std::exception& exp) {
+      LOG_ERROR("Failed to serve connection: " << exp.what());
+    }
+    accept();
+  });
+}
+
+double FeedSimulator::currentRate(
+    std::chrono::steady_clock::duration sinceStart) const {
+  if (m_options.burstEvery.count() > 0 &&
+      sinceStart % m_options.burstEvery < m_options.burstDuration) {
+    return m_options.rate * m_options.burstMultiplier;
+  }
+  return m_options.rate;
+}
+
+void FeedSimulator::generate() {
+  using Clock = std::chrono::steady_clock;
+  std::vector<SyntheticLevelChange> changes;
+  std::vector<SyntheticOrderEvent> orderEvents;
+  std::vector<std::shared_ptr<WebSocketSession>> sessions;
+  // one update per frame, or one order event per frame in l3 mode
+  std::vector<std::string> frames(1);
+  std::size_t frameCount{1};
+  Statistics interval;
+  double credit{0};
+  bool pollSessions{false};
+  auto changesPerUpdate = static_cast<double>(m_options.changesPerUpdate);
+  auto start = Clock::now();
+  auto last = start;
+  auto intervalStart = start;
+  auto nextSessionPoll = start;
+  auto nextDisconnect = start + m_options.disconnectEvery;
+  while (!m_stopFlag) {
+    auto now = Clock::now();
+    if (m_options.duration.count() > 0 && now - start >= m_options.duration) {
+      break;
+    }
+    if (m_options.disconnectEvery.count() > 0 && now >= nextDisconnect) {
+      disconnectAll();
+      ++interval.disconnects;
+      nextDisconnect += m_options.disconnectEvery;
+    }
+    if (now - intervalStart >= m_options.reportInterval) {
+      report(interval, now - intervalStart, "last interval");
+      interval = {};
+      intervalStart = now;
+    }
+    if (now >= nextSessionPoll || sessions.empty()) {
+      nextSessionPoll = now + SESSION_POLL_INTERVAL;
+      pollSessions = true;
+      std::lock_guard lock(m_sessionsMutex);
+      sessions = m_sessions;
+    }
+    if (sessions.empty()) {
+      // nobody is listening, keep the book where it is
+      std::this_thread::sleep_for(SESSION_POLL_INTERVAL);
+      last = Clock::now();
+      credit = 0;
+      continue;
+    }
+    if (m_options.rate > 0) {
+      auto rate = currentRate(now - start);
+      credit = std::min(
+          credit + rate * std::chrono::duration<double>(now - last).count(),
+          std::max(changesPerUpdate, rate * MAX_RATE_CREDIT_SECONDS));
+      last = now;
+      if (credit < changesPerUpdate) {
+        auto wait = std::chrono::duration<double>((changesPerUpdate - credit) /
+                                                  rate);
+        if (wait > std::chrono::microseconds(100)) {
+          std::this_thread::sleep_for(wait);
+        }
+        continue;
+      }
+      credit -= changesPerUpdate;
+    }
+    {
+      std::lock_guard lock(m_orderBookMutex);
+      changes.clear();
+      m_orderBook.generate(m_options.changesPerUpdate, changes);
+      if (m_orderQueues) {
+        orderEvents.clear();
+        for (const auto& change : changes) {
+          m_orderQueues->apply(change, orderEvents);
+        }
+        frameCount = std::size(orderEvents);
+        if (std::size(frames) < frameCount) {
+          frames.resize(frameCount);
+        }
+        for (std::size_t i = 0; i < frameCount; ++i) {
+          serializeOrderEvent(orderEvents[i], frames[i]);
+        }
+      } else {
+        auto updateChecksum = checksum();
+        if (updateChecksum && m_options.corruptChecksumEvery > 0 &&
+            (m_total.updates + interval.updates + 1) %
+                    m_options.corruptChecksumEvery ==
+                0) {
+          // the book is fine, only the client's verification must fail
+          *updateChecksum ^= 1;
+          ++interval.badChecksums;
+        }
+        frameCount = 1;
+        serializeUpdate(changes, updateChecksum, frames.front());
+      }
+    }
+    ++interval.updates;
+    interval.changes += std::size(changes);
+    if (m_options.gapEvery > 0 &&
+        (m_total.updates + interval.updates) % m_options.gapEvery == 0) {
+      // never sent, the client sees a sequence gap
+      ++interval.gaps;
+      continue;
+    }
+    for (std::size_t i = 0; i < frameCount; ++i) {
+      send(frames[i], sessions, std::exchange(pollSessions, false));
+      interval.bytes += std::size(frames[i]) * std::size(sessions);
+    }
+  }
+  report(interval, Clock::now() - intervalStart, "last interval");
+  report(m_total, Clock::now() - start, "achieved overall");
+}
+
+void FeedSimulator::send(
+    const std::string& frame,
+    std::vector<std::shared_ptr<WebSocketSession>>& sessions,
+    bool pollSessions) {
+  for (auto sessionIter = sessions.begin(); sessionIter != sessions.end();) {
+    auto& session = *sessionIter;
+    try {
+      if (pollSessions) {
+        session->poll();
+      }
+      session->write(frame);
+      ++sessionIter;
+    } catch (const std::exception& exp) {
+      LOG_INFO("websocket session from " << session->getRemote()
+                                         << " closed: " << exp.what());
+      {
+        std::lock_guard lock(m_sessionsMutex);
+        std::erase(m_sessions, session);
+      }
+      sessionIter = sessions.erase(sessionIter);
+    }
+  }
+}
+
+void FeedSimulator::disconnectAll() {
+  std::lock_guard lock(m_sessionsMutex);
+  LOG_INFO("Disconnecting " << std::size(m_sessions) << " websocket sessions");
+  for (auto& session : m_sessions) {
+    session->close();
+  }
+  m_sessions.clear();
+}
+
+void FeedSimulator::report(const Statistics& statistics,
+                           std::chrono::duration<double> elapsed,
+                           std::string_view what) {
+  if (&statistics != &m_total) {
+    m_total.changes += statistics.changes;
+    m_total.updates += statistics.updates;
+    m_total.bytes += statistics.bytes;
+    m_total.gaps += statistics.gaps;
+    m_total.disconnects += statistics.disconnects;
+    m_total.badChecksums += statistics.badChecksums;
+  }
+  auto seconds = std::max(elapsed.count(), 1e-9);
+  std::size_t sessionCount{0};
+  {
+    std::lock_guard lock(m_sessionsMutex);
+    sessionCount = std::size(m_sessions);
+  }
+  LOG_INFO(std::format(
+      "{}: {:.0f} level changes/s, {:.0f} updates/s, {:.2f} MB/s sent, {} "
+      "gaps, {} disconnects, {} bad checksums, {} sessions",
+      what, statistics.changes / seconds, statistics.updates / seconds,
+      statistics.bytes / seconds / 1e6, statistics.gaps,
+      statistics.disconnects, statistics.badChecksums, sessionCount));
+}
+
+std::optional<std::uint32_t> FeedSimulator::checksum() {
+  if (m_options.checksumDepth == 0 || m_orderQueues) {
+    return std::nullopt;
+  }
+  // ticks / 10^decimals is the double the client parses from the text sent
+  auto ticksPerUnit = std::pow(10.0, m_options.priceDecimals);
+  auto lotsPerUnit = std::pow(10.0, SIZE_DECIMALS);
+  auto collect = [&](const auto& levels, Levels& output) {
+    output.clear();
+    for (const auto& [price, size] : levels) {
+      if (std::size(output) == m_options.checksumDepth) {
+        break;
+      }
+      output.push_back({.price = price / ticksPerUnit,
+                        .size = size / lotsPerUnit});
+    }
+  };
+  collect(m_orderBook.getBids(), m_checksumBids);
+  collect(m_orderBook.getAsks(), m_checksumAsks);
+  return book_checksum::compute(m_checksumBids, m_checksumAsks,
+                                m_options.checksumDepth, m_checksumText);
+}
+
+void FeedSimulator::serializeUpdate(
+    const std::vector<SyntheticLevelChange>& changes,
+    std::optional<std::uint32_t> checksum, std::string& frame) const {
+  auto appendLevels = [&](bool isBid) {
+    bool first = true;
+    for (const auto& change : changes) {
+      if (change.isBid != isBid) {
+        continue;
+      }
+      frame.append(first ? "[\"" : ",[\"");
+      first = false;
+      appendDecimal(frame, change.price, m_options.priceDecimals);
+      frame.append("\",\"");
+      appendDecimal(frame, change.size, SIZE_DECIMALS);
+      frame.append("\",\"");
+      appendInteger(frame, change.sequence);
+      frame.append("\"]");
+    }
+  };
+  frame.clear();
+  frame.append("{\"topic\":\"/market/level2:");
+  frame.append(m_options.symbol);
+  frame.append(
+      "\",\"type\":\"message\",\"subject\":\"trade.l2update\","
+      "\"data\":{\"changes\":{\"asks\":[");
+  appendLevels(false);
+  frame.append("],\"bids\":[");
+  appendLevels(true);
+  frame.append("]},");
+  if (checksum) {
+    frame.append("\"checksum\":");
+    appendInteger(frame, *checksum);
+    frame.append(",");
+  }
+  frame.append("\"sequenceEnd\":");
+  appendInteger(frame, changes.empty() ? m_orderBook.getSequence()
+                                       : changes.back().sequence);
+  frame.append(",\"sequenceStart\":");
+  appendInteger(frame, changes.empty() ? m_orderBook.getSequence()
+                                       : changes.front().sequence);
+  frame.append(",\"symbol\":\"");
+  frame.append(m_options.symbol);
+  frame.append("\",\"time\":");
+  appendInteger(frame, millisecondsSinceEpoch());
+  frame.append("}}");
+}
+
+void FeedSimulator::serializeOrderEvent(const SyntheticOrderEvent& orderEvent,
+                                        std::string& frame) const {
+  using Type = SyntheticOrderEvent::Type;
+  frame.clear();
+  frame.append("{\"topic\":\"/spotMarket/level3:");
+  frame.append(m_options.symbol);
+  frame.append("\",\"type\":\"message\",\"subject\":\"");
+  frame.append(orderEvent.type == Type::OPEN     ? "open"
+               : orderEvent.type == Type::UPDATE ? "update"
+                                                 : "done");
+  frame.append("\",\"data\":{\"symbol\":\"");
+  frame.append(m_options.symbol);
+  frame.append("\",\"sequence\":");
+  appendInteger(frame, orderEvent.sequence);
+  frame.append(",\"orderId\":\"");
+  appendInteger(frame, orderEvent.orderId);
+  if (orderEvent.type != Type::DONE) {
+    frame.append("\",\"side\":\"");
+    frame.append(orderEvent.isBid ? "buy" : "sell");
+    frame.append("\",\"price\":\"");
+    appendDecimal(frame, orderEvent.price, m_options.priceDecimals);
+    frame.append("\",\"size\":\"");
+    appendDecimal(frame, orderEvent.size, SIZE_DECIMALS);
+  }
+  frame.append("\",\"ts\":");
+  appendInteger(frame, millisecondsSinceEpoch());
+  frame.append("}}");
+}
+
+std::string FeedSimulator::serializeOrderSnapshot() {
+  std::string snapshot;
+  auto appendOrders = [&](const auto& queues) {
+    bool first = true;
+    for (const auto& [price, queue] : queues) {
+      for (const auto& order : queue) {
+        snapshot.append(first ? "[\"" : ",[\"");
+        first = false;
+        appendInteger(snapshot, order.id);
+        snapshot.append("\",\"");
+        appendDecimal(snapshot, price, m_options.priceDecimals);
+        snapshot.append("\",\"");
+        appendDecimal(snapshot, order.size, SIZE_DECIMALS);
+        snapshot.append("\"]");
+      }
+    }
+  };
+  std::lock_guard lock(m_orderBookMutex);
+  snapshot.append("{\"code\":\"200000\",\"data\":{\"time\":");
+  appendInteger(snapshot, millisecondsSinceEpoch());
+  snapshot.append(",\"sequence\":\"");
+  appendInteger(snapshot, m_orderQueues->getSequence());
+  snapshot.append("\",\"bids\":[");
+  appendOrders(m_orderQueues->getBids());
+  snapshot.append("],\"asks\":[");
+  appendOrders(m_orderQueues->getAsks());
+  snapshot.append("]}}");
+  return snapshot;
+}
+
+std::string FeedSimulator::serializeSnapshot() {
+  std::string snapshot;
+  auto appendLevels = [&](const auto& levels) {
+    bool first = true;
+    for (const auto& [price, size] : levels) {
+      snapshot.append(first ? "[\"" : ",[\"");
+      first = false;
+      appendDecimal(snapshot, price, m_options.priceDecimals);
+      snapshot.append("\",\"");
+      appendDecimal(snapshot, size, SIZE_DECIMALS);
+      snapshot.append("\"]");
+    }
+  };
+  std::lock_guard lock(m_orderBookMutex);
+  snapshot.append("{\"code\":\"200000\",\"data\":{\"time\":");
+  appendInteger(snapshot, millisecondsSinceEpoch());
+  snapshot.append(",\"sequence\":\"");
+  appendInteger(snapshot, m_orderBook.getSequence());
+  snapshot.append("\",\"bids\":[");
+  appendLevels(m_orderBook.getBids());
+  snapshot.append("],\"asks\":[");
+  appendLevels(m_orderBook.getAsks());
+  snapshot.append("]");
+  if (auto snapshotChecksum = checksum()) {
+    snapshot.append(",\"checksum\":");
+    appendInteger(snapshot, *snapshotChecksum);
+  }
+  snapshot.append("}}");
+  return snapshot;
+}
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "SyntheticOrderBook.hpp"
+#include "common_header.h"
+
+struct FeedSimulatorOptions {
+  std::string host{"0.0.0.0"};
+  std::string port{"40000"};
+  std::string simDataPath;
+  std::string symbol{"BTC-USDT"};
+  // prices are integer ticks of 10^-priceDecimals
+  int priceDecimals{2};
+  std::size_t maxLevels{500};
+  std::size_t stepsPerPathPoint{10000};
+  std::size_t changesPerUpdate{20};
+  // level changes per second, 0 sends flat out
+  double rate{100'000};
+  // every burstEvery the rate is multiplied by burstMultiplier for
+  // burstDuration, 0 disables bursts
+  std::chrono::milliseconds burstEvery{0};
+  std::chrono::milliseconds burstDuration{0};
+  double burstMultiplier{10};
+  // drop one generated update every gapEvery updates, 0 disables gaps
+  std::size_t gapEvery{0};
+  // levels per side covered by the checksum sent with updates and snapshots,
+  // 0 sends none
+  std::size_t checksumDepth{25};
+  // send a wrong checksum every corruptChecksumEvery updates, 0 never
+  std::size_t corruptChecksumEvery{0};
+  // drop all websocket connections this often, 0 never
+  std::chrono::milliseconds disconnectEvery{0};
+  std::chrono::milliseconds snapshotDelay{0};
+  // serve an order level feed (--feed kucoin-l3) instead of level updates
+  bool l3{false};
+  // accept permessage-deflate when a client offers it
+  bool deflate{false};
+  std::chrono::milliseconds reportInterval{1000};
+  // stop after this long, 0 runs until signaled
+  std::chrono::milliseconds duration{0};
+  std::uint64_t seed{1};
+};
+
+class WebSocketSession;
+
+// Serves the simulator's /ws and /snapshot protocol from a SyntheticOrderBook
+// at a paced or flat out rate, one generator thread writes every update to
+// all websocket sessions and a second thread accepts connections and answers
+// snapshot requests.
+class FeedSimulator {
+  FeedSimulatorOptions m_options;
+  // io_context, acceptor and signal set, kept out of this header
+  struct Network;
+  std::unique_ptr<Network> m_network;
+  std::mutex m_orderBookMutex;
+  SyntheticOrderBook m_orderBook;
+  // order queues behind m_orderBook in l3 mode
+  std::optional<SyntheticOrderQueues> m_orderQueues;
+  std::mutex m_sessionsMutex;
+  std::vector<std::shared_ptr<WebSocketSession>> m_sessions;
+  std::atomic<bool> m_stopFlag{false};
+
+  struct Statistics {
+    std::uint64_t changes{0};
+    std::uint64_t updates{0};
+    std::uint64_t bytes{0};
+    std::uint64_t gaps{0};
+    std::uint64_t disconnects{0};
+    std::uint64_t badChecksums{0};
+  };
+  Statistics m_total;
+
+  void accept();
+  void generate();
+  // Writes `frame` to every session, dropping the ones that fail.
+  void send(const std::string& frame,
+            std::vector<std::shared_ptr<WebSocketSession>>& sessions,
+            bool pollSessions);
+  void disconnectAll();
+  void report(const Statistics& statistics,
+              std::chrono::duration<double> elapsed, std::string_view what);
+  double currentRate(std::chrono::steady_clock::duration sinceStart) const;
+  // scratch space of checksum(), guarded by m_orderBookMutex
+  Levels m_checksumBids;
+  Levels m_checksumAsks;
+  std::string m_checksumText;
+  // Checksum of the book's top levels as a client holding the same book
+  // computes it, caller holds m_orderBookMutex.
+  std::optional<std::uint32_t> checksum();
+  void serializeUpdate(const std::vector<SyntheticLevelChange>& changes,
+                       std::optional<std::uint32_t> checksum,
+                       std::string& frame) const;
+  std::string serializeSnapshot();
+  void serializeOrderEvent(const SyntheticOrderEvent& orderEvent,
+                           std::string& frame) const;
+  std::string serializeOrderSnapshot();
+
+ public:
+  explicit FeedSimulator(FeedSimulatorOptions options);
+  ~FeedSimulator();
+  void run();
+};
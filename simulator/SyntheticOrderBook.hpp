@@ -0,0 +1,298 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <iterator>
+#include <map>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+// Level change produced by SyntheticOrderBook. Prices and sizes are integers
+// (ticks and lots) so they print exactly.
+struct SyntheticLevelChange {
+  bool isBid;
+  std::int64_t price;
+  // 0 removes the level
+  std::int64_t size;
+  std::uint64_t sequence;
+};
+
+// Order book driven by a recorded price path. The mid price walks from one
+// path point to the next over `stepsPerPathPoint` level changes, the top of
+// the book follows it and the rest of the levels churn with a depth profile
+// that concentrates activity near the top, like real venues do.
+class SyntheticOrderBook {
+  using BidLevels = std::map<std::int64_t, std::int64_t, std::greater<>>;
+  using AskLevels = std::map<std::int64_t, std::int64_t>;
+
+  static constexpr std::int64_t MAX_HALF_SPREAD = 5;
+
+  std::vector<std::int64_t> m_pricePath;
+  std::size_t m_stepsPerPathPoint;
+  std::size_t m_maxLevels;
+  std::size_t m_pathIndex{0};
+  std::size_t m_step{0};
+  std::uint64_t m_sequence{0};
+  BidLevels m_bids;
+  AskLevels m_asks;
+  std::mt19937_64 m_random;
+  std::uniform_int_distribution<std::int64_t> m_size{10'000, 100'000'000};
+  std::uniform_int_distribution<std::int64_t> m_halfSpread{1,
+                                                          MAX_HALF_SPREAD};
+  // depth (in levels) of a change and distance (in ticks) of a new level
+  std::geometric_distribution<std::size_t> m_depth{0.05};
+  std::geometric_distribution<std::int64_t> m_distance{0.2};
+  std::uniform_real_distribution<double> m_uniform{0, 1};
+
+  std::int64_t getMid() const {
+    auto from = m_pricePath[m_pathIndex];
+    auto to = m_pricePath[(m_pathIndex + 1) % std::size(m_pricePath)];
+    return from + (to - from) * static_cast<std::int64_t>(m_step) /
+                      static_cast<std::int64_t>(m_stepsPerPathPoint);
+  }
+
+  void advance() {
+    if (++m_step < m_stepsPerPathPoint) {
+      return;
+    }
+    m_step = 0;
+    m_pathIndex = (m_pathIndex + 1) % std::size(m_pricePath);
+  }
+
+  template <typename Levels>
+  void set(Levels& levels, bool isBid, std::int64_t price, std::int64_t size,
+           std::vector<SyntheticLevelChange>& changes) {
+    if (size == 0) {
+      levels.erase(price);
+    } else {
+      levels[price] = size;
+    }
+    changes.push_back({.isBid = isBid,
+                       .price = price,
+                       .size = size,
+                       .sequence = ++m_sequence});
+  }
+
+  // Keeps the top of `levels` strictly behind the mid and at most
+  // MAX_HALF_SPREAD ticks away from it, returns false when nothing had to
+  // change.
+  template <typename Levels>
+  bool followMid(Levels& levels, bool isBid, std::int64_t mid,
+                 std::vector<SyntheticLevelChange>& changes) {
+    auto isBetter = levels.key_comp();
+    if (!levels.empty() && !isBetter(mid, levels.begin()->first)) {
+      set(levels, isBid, levels.begin()->first, 0, changes);
+      return true;
+    }
+    auto limit = isBid ? mid - MAX_HALF_SPREAD : mid + MAX_HALF_SPREAD;
+    if (levels.empty() || isBetter(limit, levels.begin()->first)) {
+      auto halfSpread = m_halfSpread(m_random);
+      set(levels, isBid, isBid ? mid - halfSpread : mid + halfSpread,
+          m_size(m_random), changes);
+      return true;
+    }
+    return false;
+  }
+
+  template <typename Levels>
+  void churn(Levels& levels, bool isBid,
+             std::vector<SyntheticLevelChange>& changes) {
+    if (std::size(levels) > m_maxLevels) {
+      set(levels, isBid, std::prev(levels.end())->first, 0, changes);
+      return;
+    }
+    // a side the mid ran through is refilled from its far end first
+    bool refill = std::size(levels) < m_maxLevels / 2;
+    auto depth = refill ? std::size(levels) - 1
+                        : std::min(m_depth(m_random), std::size(levels) - 1);
+    auto levelIter = std::next(levels.begin(), depth);
+    auto action = refill ? 1.0 : m_uniform(m_random);
+    if (action < 0.6) {
+      set(levels, isBid, levelIter->first, m_size(m_random), changes);
+    } else if (action < 0.8 && depth > 0) {
+      set(levels, isBid, levelIter->first, 0, changes);
+    } else {
+      // new level behind the chosen one, never better than the top
+      auto distance = 1 + m_distance(m_random);
+      auto price = isBid ? levelIter->first - distance
+                         : levelIter->first + distance;
+      if (price > 0) {
+        set(levels, isBid, price, m_size(m_random), changes);
+      } else {
+        set(levels, isBid, levelIter->first, m_size(m_random), changes);
+      }
+    }
+  }
+
+ public:
+  SyntheticOrderBook(std::vector<std::int64_t> pricePath,
+                     std::size_t stepsPerPathPoint, std::size_t maxLevels,
+                     std::uint64_t seed)
+      : m_pricePath{std::move(pricePath)},
+        m_stepsPerPathPoint{std::max<std::size_t>(stepsPerPathPoint, 1)},
+        m_maxLevels{std::max<std::size_t>(maxLevels, 2)},
+        m_random{seed} {
+    if (m_pricePath.empty()) {
+      throw std::runtime_error("Price path is empty");
+    }
+    std::vector<SyntheticLevelChange> changes;
+    auto mid = getMid();
+    auto bid = mid - m_halfSpread(m_random);
+    auto ask = mid + m_halfSpread(m_random);
+    for (std::size_t i = 0; i < m_maxLevels; ++i) {
+      set(m_bids, true, bid, m_size(m_random), changes);
+      set(m_asks, false, ask, m_size(m_random), changes);
+      bid -= 1 + m_distance(m_random);
+      ask += 1 + m_distance(m_random);
+    }
+  }
+
+  // Appends `count` level changes, each with the next sequence.
+  void generate(std::size_t count,
+                std::vector<SyntheticLevelChange>& changes) {
+    for (std::size_t i = 0; i < count; ++i) {
+      advance();
+      auto mid = getMid();
+      if (followMid(m_bids, true, mid, changes) ||
+          followMid(m_asks, false, mid, changes)) {
+        continue;
+      }
+      if (m_uniform(m_random) < 0.5) {
+        churn(m_bids, true, changes);
+      } else {
+        churn(m_asks, false, changes);
+      }
+    }
+  }
+
+  std::uint64_t getSequence() const { return m_sequence; }
+
+  const BidLevels& getBids() const { return m_bids; }
+
+  const AskLevels& getAsks() const { return m_asks; }
+};
+
+// Order event produced by SyntheticOrderQueues, sizes are in lots.
+struct SyntheticOrderEvent {
+  enum struct Type { OPEN, UPDATE, DONE };
+  Type type;
+  std::uint64_t orderId;
+  bool isBid;
+  std::int64_t price;
+  // remaining size for OPEN and UPDATE
+  std::int64_t size;
+  std::uint64_t sequence;
+};
+
+// Order level view of a SyntheticOrderBook. Each level change is turned into
+// the order events that explain it: growth opens an order at the back of the
+// queue, shrinking fills orders from the front or cancels them from the back,
+// a removed level finishes all of its orders. Events carry their own
+// sequence, independent of the level changes'.
+class SyntheticOrderQueues {
+ public:
+  struct Order {
+    std::uint64_t id;
+    std::int64_t size;
+  };
+  using Queue = std::deque<Order>;
+  using BidQueues = std::map<std::int64_t, Queue, std::greater<>>;
+  using AskQueues = std::map<std::int64_t, Queue>;
+
+ private:
+  BidQueues m_bids;
+  AskQueues m_asks;
+  std::uint64_t m_nextOrderId{1};
+  std::uint64_t m_sequence{0};
+  std::mt19937_64 m_random;
+  std::uniform_int_distribution<int> m_ordersPerLevel{1, 4};
+  std::uniform_real_distribution<double> m_uniform{0, 1};
+
+  void emit(SyntheticOrderEvent::Type type, const Order& order, bool isBid,
+            std::int64_t price, std::vector<SyntheticOrderEvent>& events) {
+    events.push_back({.type = type,
+                      .orderId = order.id,
+                      .isBid = isBid,
+                      .price = price,
+                      .size = order.size,
+                      .sequence = ++m_sequence});
+  }
+
+  template <typename Queues, typename Levels>
+  void fill(Queues& queues, bool isBid, const Levels& levels) {
+    for (const auto& [price, size] : levels) {
+      // split the level over a few orders
+      auto& queue = queues[price];
+      auto orders = std::min<std::int64_t>(m_ordersPerLevel(m_random), size);
+      for (std::int64_t i = 0; i < orders; ++i) {
+        auto orderSize = i + 1 < orders ? size / orders
+                                        : size - (orders - 1) * (size / orders);
+        queue.push_back({.id = m_nextOrderId++, .size = orderSize});
+      }
+    }
+  }
+
+  template <typename Queues>
+  void apply(Queues& queues, const SyntheticLevelChange& change,
+             std::vector<SyntheticOrderEvent>& events) {
+    using Type = SyntheticOrderEvent::Type;
+    auto& queue = queues[change.price];
+    std::int64_t total{0};
+    for (const auto& order : queue) {
+      total += order.size;
+    }
+    if (change.size > total) {
+      queue.push_back({.id = m_nextOrderId++, .size = change.size - total});
+      emit(Type::OPEN, queue.back(), change.isBid, change.price, events);
+    }
+    // fills take the oldest orders, cancels are mostly the newest
+    bool fromFront = change.size == 0 || m_uniform(m_random) < 0.5;
+    for (auto excess = total - change.size; excess > 0;) {
+      auto& order = fromFront ? queue.front() : queue.back();
+      if (order.size > excess) {
+        order.size -= excess;
+        emit(Type::UPDATE, order, change.isBid, change.price, events);
+        break;
+      }
+      excess -= order.size;
+      emit(Type::DONE, order, change.isBid, change.price, events);
+      if (fromFront) {
+        queue.pop_front();
+      } else {
+        queue.pop_back();
+      }
+    }
+    if (queue.empty()) {
+      queues.erase(change.price);
+    }
+  }
+
+ public:
+  template <typename BidLevels, typename AskLevels>
+  SyntheticOrderQueues(const BidLevels& bids, const AskLevels& asks,
+                       std::uint64_t sequence, std::uint64_t seed)
+      : m_sequence{sequence}, m_random{seed} {
+    fill(m_bids, true, bids);
+    fill(m_asks, false, asks);
+  }
+
+  // Appends the order events behind `change`, each with the next sequence.
+  void apply(const SyntheticLevelChange& change,
+             std::vector<SyntheticOrderEvent>& events) {
+    if (change.isBid) {
+      apply(m_bids, change, events);
+    } else {
+      apply(m_asks, change, events);
+    }
+  }
+
+  std::uint64_t getSequence() const { return m_sequence; }
+
+  const BidQueues& getBids() const { return m_bids; }
+
+  const AskQueues& getAsks() const { return m_asks; }
+};
@@ -0,0 +1,133 @@
+#include <boost/program_options.hpp>
+#include <filesystem>
+#include <format>
+#include <iostream>
+#include <string>
+
+#include "FeedSimulator.h"
+#include "logging.h"
+
+namespace po = boost::program_options;
+
+int main(int argc, char* argv[]) {
+  try {
+    po::options_description desc("Allowed options");
+    desc.add_options()                    //
+        ("help", "produce help message")  //
+        ("host", po::value<std::string>()->default_value("0.0.0.0"),
+         "webserver listening host")  //
+        ("port", po::value<std::string>()->default_value("40000"),
+         "webserver listening port")  //
+        ("sim_data", po::value<std::string>()->default_value(""),
+         "Price path json, the 'close' prices drive the mid price, default "
+         "is simulator/sim_data.json or ../simulator/sim_data.json")  //
+        ("symbol", po::value<std::string>()->default_value("BTC-USDT"),
+         "Symbol written into the updates")  //
+        ("rate", po::value<double>()->default_value(100'000),
+         "Level changes per second paced against the wall clock, 0 sends "
+         "flat out as fast as the clients read")  //
+        ("changes_per_update", po::value<std::size_t>()->default_value(20),
+         "Level changes carried by one websocket update")  //
+        ("max_levels", po::value<std::size_t>()->default_value(500),
+         "Levels kept per side")  //
+        ("steps_per_price", po::value<std::size_t>()->default_value(10000),
+         "Level changes over which the mid moves from one sim_data price to "
+         "the next")  //
+        ("price_decimals", po::value<int>()->default_value(2),
+         "Decimal places of a price tick")  //
+        ("burst_every", po::value<int>()->default_value(0),
+         "Milliseconds between rate bursts, 0 disables bursts")  //
+        ("burst_duration", po::value<int>()->default_value(100),
+         "Milliseconds a burst lasts")  //
+        ("burst_multiplier", po::value<double>()->default_value(10),
+         "Rate multiplier during a burst")  //
+        ("gap_every", po::value<std::size_t>()->default_value(0),
+         "Drop one update every this many updates to inject a sequence gap, "
+         "0 disables gaps")  //
+        ("checksum_depth", po::value<std::size_t>()->default_value(25),
+         "Levels per side covered by the CRC32 checksum sent with every "
+         "update and snapshot, 0 sends none")  //
+        ("corrupt_checksum_every", po::value<std::size_t>()->default_value(0),
+         "Send a wrong checksum every this many updates, the book stays "
+         "intact, 0 never")  //
+        ("disconnect_every", po::value<int>()->default_value(0),
+         "Milliseconds between dropping all websocket connections, 0 "
+         "never")  //
+        ("snapshot_delay", po::value<int>()->default_value(0),
+         "Milliseconds to hold a snapshot response, lets updates pile up "
+         "on the client meanwhile")  //
+        ("l3", po::bool_switch()->default_value(false),
+         "Serve an order level feed, one open, update or done event per "
+         "message, for OrderBook --feed kucoin-l3")  //
+        ("deflate", po::bool_switch()->default_value(false),
+         "Accept permessage-deflate when the client offers it")  //
+        ("report_interval", po::value<int>()->default_value(1000),
+         "Milliseconds between achieved rate reports")  //
+        ("duration", po::value<int>()->default_value(0),
+         "Milliseconds to run for, 0 runs until SIGINT or SIGTERM")  //
+        ("seed", po::value<std::uint64_t>()->default_value(1),
+         "Random seed of the level churn");
+
+    po::variables_map vm;
+    po::store(po::parse_command_line(argc, argv, desc), vm);
+    po::notify(vm);
+
+    if (vm.count("help")) {
+      std::cout << desc << std::endl;
+      return 1;
+    }
+
+    FeedSimulatorOptions options{
+        .host = vm["host"].as<std::string>(),
+        .port = vm["port"].as<std::string>(),
+        .simDataPath = vm["sim_data"].as<std::string>(),
+        .symbol = vm["symbol"].as<std::string>(),
+        .priceDecimals = vm["price_decimals"].as<int>(),
+        .maxLevels = vm["max_levels"].as<std::size_t>(),
+        .stepsPerPathPoint = vm["steps_per_price"].as<std::size_t>(),
+        .changesPerUpdate = vm["changes_per_update"].as<std::size_t>(),
+        .rate = vm["rate"].as<double>(),
+        .burstEvery = std::chrono::milliseconds(vm["burst_every"].as<int>()),
+        .burstDuration =
+            std::chrono::milliseconds(vm["burst_duration"].as<int>()),
+        .burstMultiplier = vm["burst_multiplier"].as<double>(),
+        .gapEvery = vm["gap_every"].as<std::size_t>(),
+        .checksumDepth = vm["checksum_depth"].as<std::size_t>(),
+        .corruptChecksumEvery = vm["corrupt_checksum_every"].as<std::size_t>(),
+        .disconnectEvery =
+            std::chrono::milliseconds(vm["disconnect_every"].as<int>()),
+        .snapshotDelay =
+            std::chrono::milliseconds(vm["snapshot_delay"].as<int>()),
+        .l3 = vm["l3"].as<bool>(),
+        .deflate = vm["deflate"].as<bool>(),
+        .reportInterval =
+            std::chrono::milliseconds(vm["report_interval"].as<int>()),
+        .duration = std::chrono::milliseconds(vm["duration"].as<int>()),
+        .seed = vm["seed"].as<std::uint64_t>()};
+
+    if (options.simDataPath.empty()) {
+      options.simDataPath = "simulator/sim_data.json";
+      if (!std::filesystem::is_regular_file(options.simDataPath)) {
+        options.simDataPath = "../simulator/sim_data.json";
+      }
+    }
+    if (options.rate < 0 || options.changesPerUpdate < 1 ||
+        options.priceDecimals < 0 || options.priceDecimals > 12 ||
+        options.burstMultiplier <= 0 ||
+        options.reportInterval.count() < 1) {
+      LOG_ERROR(
+          "rate must not be negative, changes_per_update, report_interval "
+          "and burst_multiplier must be positive, price_decimals must be "
+          "within 0 to 12");
+      std::cout << desc << std::endl;
+      return 1;
+    }
+
+    FeedSimulator feedSimulator(std::move(options));
+    feedSimulator.run();
+  } catch (const std::exception& exp) {
+    std::cout << "exception occured: " << exp.what() << std::endl;
+    return 1;
+  }
+  return 0;
+}
@@ -1,6 +1,7 @@
 #!/usr/bin/python3
 
 import utils
+import venue_formats
 import argparse
 import random
 import json
@@ -424,7 +425,8 @@ class OrderBookSimulator:
             if self.lastIncrementalUpdates and None != self.webSocket:
                 logging.debug("sending data on websocket")
                 for lastIncrementalUpdate in self.lastIncrementalUpdates:
-                    await self.webSocket.send_json(lastIncrementalUpdate)
+                    await self.webSocket.send_json(
+                        self.venueFormat.incrementalUpdate(lastIncrementalUpdate))
                 self.lastIncrementalUpdates.clear()
                 return True
         except Exception as ex:
@@ -506,10 +508,11 @@ class OrderBookSimulator:
             self.pendingSnapshotRequestSignals.put(signal)
             snapshot = self.fakeOrderBook.getSnapshot()
             await signal.wait()
-            return web.json_response(snapshot)
+            return web.json_response(self.venueFormat.snapshot(snapshot))
         else:
             await asyncio.sleep(1)
-            return web.json_response(self.fakeOrderBook.getSnapshot())
+            return web.json_response(
+                self.venueFormat.snapshot(self.fakeOrderBook.getSnapshot()))
 
     async def setSnapshot(self, request):
         if not self.passive:
@@ -614,6 +617,9 @@ class OrderBookSimulator:
         app.add_routes([
             web.get('/isRunning',   self.isRunning),
             web.get('/snapshot',   self.snapshotHandler),
+            # snapshot paths of the binance and binance-futures feeds
+            web.get('/api/v3/depth',   self.snapshotHandler),
+            web.get('/fapi/v1/depth',   self.snapshotHandler),
             web.post('/setSnapshot',   self.setSnapshot),
             web.post('/addLevel',   self.addLevel),
             web.post('/removeLevel',   self.removeLevel),
@@ -627,8 +633,9 @@ class OrderBookSimulator:
         ])
         return web.AppRunner(app)
 
-    async def startServer(self, host, port, passive):
+    async def startServer(self, host, port, passive, venue):
         self.passive = passive
+        self.venueFormat = venue_formats.VENUE_FORMATS[venue]
         await self.renewFakeOrderBook()
         runner = self.createRunner()
         await runner.setup()
@@ -646,6 +653,9 @@ if __name__ == "__main__":
                         help="webserver listening port")
     parser.add_argument("--passive", type=bool, default=False,
                         help="A passive simulator only acts via web api")
+    parser.add_argument("--venue", type=str, default="kucoin",
+                        choices=list(venue_formats.VENUE_FORMATS),
+                        help="message schema of the websocket and snapshot feeds")
     parser.add_argument('--log-level', default='INFO',
                         choices=['DEBUG', 'INFO', 'WARNING', 'ERROR', 'CRITICAL'],
                         help='Set the logging level.')
@@ -663,5 +673,5 @@ if __name__ == "__main__":
     asyncio.set_event_loop(loop)
     orderBookSimulator = OrderBookSimulator(loop)
     loop.run_until_complete(
-        orderBookSimulator.startServer(args.host, args.port, args.passive))
+        orderBookSimulator.startServer(args.host, args.port, args.passive, args.venue))
     loop.run_forever()
@@ -0,0 +1,66 @@
+#!/usr/bin/python3
+
+# FakeOrderBook produces KuCoin shaped messages, these convert them to the
+# shape other venues use so OrderBook --feed <venue> can be exercised.
+
+
+def toBinanceLevels(levels):
+    # Binance levels carry no per level sequence
+    return [[price, size] for price, size, *_ in levels]
+
+
+class KucoinFormat:
+    name = "kucoin"
+
+    def incrementalUpdate(self, update):
+        return update
+
+    def snapshot(self, snapshot):
+        return snapshot
+
+
+class BinanceFormat:
+    name = "binance"
+
+    def incrementalUpdate(self, update):
+        data = update["data"]
+        return {
+            "e": "depthUpdate",
+            "E": data["time"],
+            "s": data["symbol"].replace("-", ""),
+            "U": data["sequenceStart"],
+            "u": data["sequenceEnd"],
+            "b": toBinanceLevels(data["changes"]["bids"]),
+            "a": toBinanceLevels(data["changes"]["asks"]),
+        }
+
+    def snapshot(self, snapshot):
+        data = snapshot["data"]
+        return {
+            "lastUpdateId": int(data["sequence"]),
+            "bids": data["bids"],
+            "asks": data["asks"],
+        }
+
+
+class BinanceFuturesFormat(BinanceFormat):
+    name = "binance-futures"
+
+    def incrementalUpdate(self, update):
+        result = super().incrementalUpdate(update)
+        result["T"] = result["E"]
+        # last id of the previous update
+        result["pu"] = result["U"] - 1
+        return result
+
+    def snapshot(self, snapshot):
+        result = super().snapshot(snapshot)
+        result["E"] = snapshot["data"]["time"]
+        result["T"] = snapshot["data"]["time"]
+        return result
+
+
+VENUE_FORMATS = {
+    venueFormat.name: venueFormat
+    for venueFormat in [KucoinFormat(), BinanceFormat(), BinanceFuturesFormat()]
+}
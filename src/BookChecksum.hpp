@@ -0,0 +1,124 @@
+#pragma once
+
+#include <array>
+#include <charconv>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <string>
+#include <system_error>
+
+#include "common_header.h"
+
+// CRC32 over the top of the book in the layout OKX, Bitget and Gate publish:
+// "bid0price:bid0size:ask0price:ask0size:bid1price:..." for the first `depth`
+// levels of each side, a side that runs out of levels just stops contributing.
+// Prices and sizes print in their shortest fixed form ("3988.5", "8") so any
+// copy of the book holding the same numbers gets the same checksum.
+namespace book_checksum {
+
+inline constexpr std::size_t DEFAULT_DEPTH = 25;
+
+// IEEE 802.3 polynomial (zlib, venues), reflected. The crc32 instruction of
+// SSE 4.2 and ARMv8 computes CRC32C instead, so this is table driven,
+// slicing by 8 to consume 8 bytes per step.
+inline constexpr std::uint32_t POLYNOMIAL = 0xEDB88320;
+
+using Table = std::array<std::array<std::uint32_t, 256>, 8>;
+
+consteval Table makeTable() {
+  Table table{};
+  for (std::uint32_t i = 0; i < 256; ++i) {
+    auto crc = i;
+    for (int bit = 0; bit < 8; ++bit) {
+      crc = (crc >> 1) ^ ((crc & 1) ? POLYNOMIAL : 0);
+    }
+    table[0][i] = crc;
+  }
+  for (std::uint32_t i = 0; i < 256; ++i) {
+    for (std::size_t slice = 1; slice < 8; ++slice) {
+      auto previous = table[slice - 1][i];
+      table[slice][i] = (previous >> 8) ^ table[0][previous & 0xFF];
+    }
+  }
+  return table;
+}
+
+inline constexpr Table TABLE = makeTable();
+
+inline std::uint32_t crc32(const char* data, std::size_t size) {
+  std::uint32_t crc = 0xFFFFFFFF;
+  auto bytes = reinterpret_cast<const unsigned char*>(data);
+  for (; size >= 8; size -= 8, bytes += 8) {
+    auto low = crc ^ (std::uint32_t(bytes[0]) | std::uint32_t(bytes[1]) << 8 |
+                      std::uint32_t(bytes[2]) << 16 |
+                      std::uint32_t(bytes[3]) << 24);
+    crc = TABLE[7][low & 0xFF] ^ TABLE[6][(low >> 8) & 0xFF] ^
+          TABLE[5][(low >> 16) & 0xFF] ^ TABLE[4][low >> 24] ^
+          TABLE[3][bytes[4]] ^ TABLE[2][bytes[5]] ^ TABLE[1][bytes[6]] ^
+          TABLE[0][bytes[7]];
+  }
+  for (; size > 0; --size, ++bytes) {
+    crc = (crc >> 8) ^ TABLE[0][(crc ^ *bytes) & 0xFF];
+  }
+  return crc ^ 0xFFFFFFFF;
+}
+
+inline void appendNumber(double value, std::string& text) {
+  char buffer[64];
+  auto [end, error] = std::to_chars(buffer, buffer + sizeof(buffer), value,
+                                    std::chars_format::fixed);
+  if (error == std::errc{}) {
+    text.append(buffer, end);
+  }
+}
+
+inline void appendLevel(const Level& level, std::string& text) {
+  if (!text.empty()) {
+    text.push_back(':');
+  }
+  appendNumber(level.price, text);
+  text.push_back(':');
+  appendNumber(level.size, text);
+}
+
+// `bids` and `asks` iterate best first and yield Level, either directly
+// (Levels) or as the mapped value of the book's maps. `text` is scratch
+// space, passing the same string keeps its capacity between calls.
+template <typename BidRange, typename AskRange>
+std::uint32_t compute(const BidRange& bids, const AskRange& asks,
+                      std::size_t depth, std::string& text) {
+  auto levelOf = [](const auto& entry) -> const Level& {
+    if constexpr (requires { entry.second; }) {
+      return entry.second;
+    } else {
+      return entry;
+    }
+  };
+  text.clear();
+  auto bidIter = std::begin(bids);
+  auto askIter = std::begin(asks);
+  for (std::size_t i = 0; i < depth; ++i) {
+    bool hasBid = bidIter != std::end(bids);
+    bool hasAsk = askIter != std::end(asks);
+    if (!hasBid && !hasAsk) {
+      break;
+    }
+    if (hasBid) {
+      appendLevel(levelOf(*bidIter++), text);
+    }
+    if (hasAsk) {
+      appendLevel(levelOf(*askIter++), text);
+    }
+  }
+  return crc32(text.data(), std::size(text));
+}
+
+template <typename BidRange, typename AskRange>
+std::uint32_t compute(const BidRange& bids, const AskRange& asks,
+                      std::size_t depth) {
+  std::string text;
+  return compute(bids, asks, depth, text);
+}
+
+}  // namespace book_checksum
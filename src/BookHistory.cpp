@@ -0,0 +1,277 @@
+#include "BookHistory.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <filesystem>
+#include <format>
+#include <ranges>
+#include <stdexcept>
+
+#include "OrderBook.hpp"
+#include "logging.h"
+
+namespace book_history {
+
+namespace {
+
+const std::uint32_t HISTORY_FILE_VERSION = 1;
+// "OBUPDLOG", "OBCHKDAT" and "OBCHKIDX" as little endian integers
+const std::uint64_t UPDATE_LOG_MAGIC = 0x474f4c4450554f42;
+const std::uint64_t CHECKPOINTS_MAGIC = 0x5441444b48434f42;
+const std::uint64_t CHECKPOINT_INDEX_MAGIC = 0x5844494b48434f42;
+
+const std::size_t INITIAL_FILE_SIZE = 1024 * 1024;
+
+std::atomic_ref<std::uint64_t> committedSizeOf(const char* data) {
+  auto* header = reinterpret_cast<FileHeader*>(const_cast<char*>(data));
+  return std::atomic_ref<std::uint64_t>(header->committedSize);
+}
+
+template <typename LevelsType>
+char* writeLevels(char* output, const LevelsType& levels) {
+  for (const auto& level : levels) {
+    LevelRecord levelRecord{.price = level.price,
+                            .size = level.size,
+                            .sequence = level.sequence};
+    std::memcpy(output, &levelRecord, sizeof(levelRecord));
+    output += sizeof(levelRecord);
+  }
+  return output;
+}
+
+const char* readLevels(const char* input, std::uint32_t count,
+                       Levels& levels) {
+  levels.resize(count);
+  for (auto& level : levels) {
+    LevelRecord levelRecord;
+    std::memcpy(&levelRecord, input, sizeof(levelRecord));
+    input += sizeof(levelRecord);
+    level = {.price = levelRecord.price,
+             .size = levelRecord.size,
+             .sequence = levelRecord.sequence};
+  }
+  return input;
+}
+
+}  // namespace
+
+HistoryFile::HistoryFile(const std::string& path, std::uint64_t magic,
+                         MappedFile::Mode mode)
+    : m_file{path, mode,
+             mode == MappedFile::Mode::READ_WRITE ? INITIAL_FILE_SIZE : 0} {
+  if (m_file.size() < sizeof(FileHeader)) {
+    throw std::runtime_error(
+        std::format("History file '{}' is too short", path));
+  }
+  auto* header = reinterpret_cast<FileHeader*>(m_file.data());
+  if (header->magic == 0 && mode == MappedFile::Mode::READ_WRITE) {
+    // freshly created file
+    header->magic = magic;
+    header->version = HISTORY_FILE_VERSION;
+    commit(sizeof(FileHeader));
+  }
+  if (header->magic != magic || header->version != HISTORY_FILE_VERSION) {
+    throw std::runtime_error(std::format(
+        "'{}' is not a version {} history file", path, HISTORY_FILE_VERSION));
+  }
+}
+
+std::size_t HistoryFile::getCommittedSize() const {
+  // a reader's mapping may be older than the writer's latest commit
+  return std::min<std::size_t>(
+      committedSizeOf(m_file.data()).load(std::memory_order_acquire),
+      m_file.size());
+}
+
+void HistoryFile::commit(std::size_t committedSize) {
+  committedSizeOf(m_file.data())
+      .store(committedSize, std::memory_order_release);
+}
+
+char* HistoryFile::reserve(std::size_t offset, std::size_t size) {
+  m_file.reserve(offset + size);
+  return m_file.data() + offset;
+}
+
+}  // namespace book_history
+
+using namespace book_history;
+
+namespace {
+
+std::string historyPath(const std::string& directory, std::string_view name) {
+  return (std::filesystem::path(directory) / name).string();
+}
+
+std::string createHistoryPath(const std::string& directory,
+                              std::string_view name) {
+  std::filesystem::create_directories(directory);
+  return historyPath(directory, name);
+}
+
+}  // namespace
+
+BookHistoryWriter::BookHistoryWriter(
+    const std::string& directory, std::chrono::milliseconds checkpointInterval)
+    : m_updateLog{createHistoryPath(directory, "updates.log"),
+                  UPDATE_LOG_MAGIC, MappedFile::Mode::READ_WRITE},
+      m_checkpoints{createHistoryPath(directory, "checkpoints.dat"),
+                    CHECKPOINTS_MAGIC, MappedFile::Mode::READ_WRITE},
+      m_checkpointIndex{createHistoryPath(directory, "checkpoints.idx"),
+                        CHECKPOINT_INDEX_MAGIC, MappedFile::Mode::READ_WRITE},
+      m_checkpointInterval{checkpointInterval} {
+  LOG_INFO("Recording book history in " << directory << ", update log has "
+                                        << m_updateLog.getCommittedSize()
+                                        << " bytes");
+}
+
+void BookHistoryWriter::stageIncrementalUpdate(
+    const IncrementalUpdate& incrementalUpdate) {
+  UpdateRecord updateRecord{
+      .sequenceStart = incrementalUpdate.sequenceStart,
+      .sequenceEnd = incrementalUpdate.sequenceEnd,
+      .timestamp = incrementalUpdate.timestamp.count(),
+      .bidCount =
+          static_cast<std::uint32_t>(std::size(incrementalUpdate.bids)),
+      .askCount =
+          static_cast<std::uint32_t>(std::size(incrementalUpdate.asks))};
+  m_stagedSize =
+      sizeof(updateRecord) +
+      (updateRecord.bidCount + updateRecord.askCount) * sizeof(LevelRecord);
+  char* output =
+      m_updateLog.reserve(m_updateLog.getCommittedSize(), m_stagedSize);
+  std::memcpy(output, &updateRecord, sizeof(updateRecord));
+  output = writeLevels(output + sizeof(updateRecord), incrementalUpdate.bids);
+  writeLevels(output, incrementalUpdate.asks);
+}
+
+void BookHistoryWriter::commitIncrementalUpdate(const OrderBook& orderBook) {
+  if (m_stagedSize == 0) {
+    return;
+  }
+  m_updateLog.commit(m_updateLog.getCommittedSize() + m_stagedSize);
+  m_stagedSize = 0;
+  if (orderBook.getLastUpdateTimestamp() - m_lastCheckpointTimestamp >=
+      m_checkpointInterval) {
+    writeCheckpoint(orderBook);
+  }
+}
+
+void BookHistoryWriter::writeCheckpoint(const OrderBook& orderBook) {
+  m_stagedSize = 0;
+  const auto& bids = orderBook.getBids();
+  const auto& asks = orderBook.getAsks();
+  CheckpointRecord checkpointRecord{
+      .sequence = orderBook.getSequence(),
+      .timestamp = orderBook.getLastUpdateTimestamp().count(),
+      .bidCount = static_cast<std::uint32_t>(std::size(bids)),
+      .askCount = static_cast<std::uint32_t>(std::size(asks))};
+  auto checkpointOffset = m_checkpoints.getCommittedSize();
+  auto checkpointSize =
+      sizeof(checkpointRecord) +
+      (checkpointRecord.bidCount + checkpointRecord.askCount) *
+          sizeof(LevelRecord);
+  char* output = m_checkpoints.reserve(checkpointOffset, checkpointSize);
+  std::memcpy(output, &checkpointRecord, sizeof(checkpointRecord));
+  output = writeLevels(output + sizeof(checkpointRecord),
+                       bids | std::views::values);
+  writeLevels(output, asks | std::views::values);
+  m_checkpoints.commit(checkpointOffset + checkpointSize);
+
+  CheckpointIndexEntry indexEntry{
+      .sequence = checkpointRecord.sequence,
+      .timestamp = checkpointRecord.timestamp,
+      .checkpointOffset = checkpointOffset,
+      .updateLogOffset = m_updateLog.getCommittedSize()};
+  auto indexOffset = m_checkpointIndex.getCommittedSize();
+  std::memcpy(m_checkpointIndex.reserve(indexOffset, sizeof(indexEntry)),
+              &indexEntry, sizeof(indexEntry));
+  m_checkpointIndex.commit(indexOffset + sizeof(indexEntry));
+  m_lastCheckpointTimestamp = orderBook.getLastUpdateTimestamp();
+}
+
+BookHistoryReader::BookHistoryReader(const std::string& directory)
+    : m_updateLog{historyPath(directory, "updates.log"), UPDATE_LOG_MAGIC,
+                  MappedFile::Mode::READ_ONLY},
+      m_checkpoints{historyPath(directory, "checkpoints.dat"),
+                    CHECKPOINTS_MAGIC, MappedFile::Mode::READ_ONLY},
+      m_checkpointIndex{historyPath(directory, "checkpoints.idx"),
+                        CHECKPOINT_INDEX_MAGIC, MappedFile::Mode::READ_ONLY} {}
+
+template <typename KeyOf>
+OrderBook BookHistoryReader::rebuild(std::uint64_t target,
+                                     KeyOf keyOf) const {
+  auto entryCount =
+      (m_checkpointIndex.getCommittedSize() - sizeof(FileHeader)) /
+      sizeof(CheckpointIndexEntry);
+  const auto* entries = reinterpret_cast<const CheckpointIndexEntry*>(
+      m_checkpointIndex.data() + sizeof(FileHeader));
+  // last checkpoint at or before target
+  const auto* entry =
+      std::upper_bound(entries, entries + entryCount, target,
+                       [&](std::uint64_t value, const auto& entry) {
+                         return value < keyOf(entry);
+                       });
+  if (entry == entries) {
+    throw std::runtime_error(
+        std::format("No book history at or before {}", target));
+  }
+  --entry;
+
+  CheckpointRecord checkpointRecord;
+  const char* input = m_checkpoints.data() + entry->checkpointOffset;
+  std::memcpy(&checkpointRecord, input, sizeof(checkpointRecord));
+  OrderBookSnapshot orderBookSnapshot{
+      .sequence = checkpointRecord.sequence,
+      .timestamp = TimePoint(checkpointRecord.timestamp)};
+  input = readLevels(input + sizeof(checkpointRecord),
+                     checkpointRecord.bidCount, orderBookSnapshot.bids);
+  readLevels(input, checkpointRecord.askCount, orderBookSnapshot.asks);
+  OrderBook orderBook;
+  orderBook.applySnapshot(std::move(orderBookSnapshot));
+
+  const char* updateLogEnd =
+      m_updateLog.data() + m_updateLog.getCommittedSize();
+  input = m_updateLog.data() + entry->updateLogOffset;
+  while (input < updateLogEnd) {
+    UpdateRecord updateRecord;
+    std::memcpy(&updateRecord, input, sizeof(updateRecord));
+    if (keyOf(updateRecord) > target) {
+      break;
+    }
+    IncrementalUpdate incrementalUpdate{
+        .sequenceStart = updateRecord.sequenceStart,
+        .sequenceEnd = updateRecord.sequenceEnd,
+        .timestamp = TimePoint(updateRecord.timestamp)};
+    input = readLevels(input + sizeof(updateRecord), updateRecord.bidCount,
+                       incrementalUpdate.bids);
+    input = readLevels(input, updateRecord.askCount, incrementalUpdate.asks);
+    orderBook.applyIncrementalUpdate(std::move(incrementalUpdate));
+  }
+  return orderBook;
+}
+
+OrderBook BookHistoryReader::rebuildAtSequence(SequenceType sequence) const {
+  struct SequenceOf {
+    std::uint64_t operator()(const CheckpointIndexEntry& entry) const {
+      return entry.sequence;
+    }
+    std::uint64_t operator()(const UpdateRecord& updateRecord) const {
+      return updateRecord.sequenceEnd;
+    }
+  };
+  return rebuild(sequence, SequenceOf{});
+}
+
+OrderBook BookHistoryReader::rebuildAtTimestamp(TimePoint timestamp) const {
+  struct TimestampOf {
+    std::uint64_t operator()(const CheckpointIndexEntry& entry) const {
+      return entry.timestamp;
+    }
+    std::uint64_t operator()(const UpdateRecord& updateRecord) const {
+      return updateRecord.timestamp;
+    }
+  };
+  return rebuild(timestamp.count(), TimestampOf{});
+}
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "MappedFile.h"
+#include "common_header.h"
+
+class OrderBook;
+
+// Book history is kept in three append only, memory mapped files:
+//  - updates.log        every applied incremental update, in apply order
+//  - checkpoints.dat    periodic full copies of the book
+//  - checkpoints.idx    fixed size entries locating each checkpoint and the
+//                       first update logged after it
+// A state at any sequence or timestamp is rebuilt from the nearest preceding
+// checkpoint plus the updates logged after it.
+namespace book_history {
+
+struct FileHeader {
+  std::uint64_t magic;
+  std::uint32_t version;
+  std::uint32_t reserved;
+  // bytes (including this header) that readers are allowed to look at
+  std::uint64_t committedSize;
+};
+
+struct LevelRecord {
+  double price;
+  double size;
+  std::uint64_t sequence;
+};
+
+// followed by bidCount + askCount LevelRecords
+struct UpdateRecord {
+  std::uint64_t sequenceStart;
+  std::uint64_t sequenceEnd;
+  std::int64_t timestamp;
+  std::uint32_t bidCount;
+  std::uint32_t askCount;
+};
+
+// followed by bidCount + askCount LevelRecords
+struct CheckpointRecord {
+  std::uint64_t sequence;
+  std::int64_t timestamp;
+  std::uint32_t bidCount;
+  std::uint32_t askCount;
+};
+
+struct CheckpointIndexEntry {
+  std::uint64_t sequence;
+  std::int64_t timestamp;
+  std::uint64_t checkpointOffset;
+  std::uint64_t updateLogOffset;
+};
+
+// One history file, bytes past the committed size are invisible to readers.
+class HistoryFile {
+  MappedFile m_file;
+
+ public:
+  HistoryFile(const std::string& path, std::uint64_t magic,
+              MappedFile::Mode mode);
+
+  std::size_t getCommittedSize() const;
+  void commit(std::size_t committedSize);
+  // pointer to `size` writable bytes at `offset`, valid until next call
+  char* reserve(std::size_t offset, std::size_t size);
+  const char* data() const { return m_file.data(); }
+};
+
+}  // namespace book_history
+
+class BookHistoryWriter {
+  book_history::HistoryFile m_updateLog;
+  book_history::HistoryFile m_checkpoints;
+  book_history::HistoryFile m_checkpointIndex;
+  std::chrono::milliseconds m_checkpointInterval;
+  TimePoint m_lastCheckpointTimestamp{0};
+  // size of the record staged past the committed end of the update log
+  std::size_t m_stagedSize{0};
+
+ public:
+  BookHistoryWriter(const std::string& directory,
+                    std::chrono::milliseconds checkpointInterval);
+
+  // Writes the update past the end of the log without making it visible,
+  // the next stage call overwrites it unless it was committed.
+  void stageIncrementalUpdate(const IncrementalUpdate& incrementalUpdate);
+  // Makes the staged update part of the history, `orderBook` must already
+  // include it and is checkpointed when the interval has elapsed.
+  void commitIncrementalUpdate(const OrderBook& orderBook);
+  void writeCheckpoint(const OrderBook& orderBook);
+};
+
+class BookHistoryReader {
+  book_history::HistoryFile m_updateLog;
+  book_history::HistoryFile m_checkpoints;
+  book_history::HistoryFile m_checkpointIndex;
+
+  template <typename KeyOf>
+  OrderBook rebuild(std::uint64_t target, KeyOf keyOf) const;
+
+ public:
+  explicit BookHistoryReader(const std::string& directory);
+
+  // Book as it was right after the last update ending at or before
+  // `sequence`.
+  OrderBook rebuildAtSequence(SequenceType sequence) const;
+  // Book as it was right after the last update stamped at or before
+  // `timestamp`.
+  OrderBook rebuildAtTimestamp(TimePoint timestamp) const;
+};
@@ -0,0 +1,119 @@
+#include "BookImage.h"
+
+#include <cstddef>
+#include <cstring>
+#include <filesystem>
+#include <format>
+#include <ranges>
+
+#include "BookChecksum.hpp"
+#include "BookHistory.h"
+#include "OrderBook.hpp"
+#include "logging.h"
+
+using book_history::LevelRecord;
+using namespace book_image;
+
+namespace {
+
+const std::uint32_t IMAGE_FILE_VERSION = 1;
+// "OBBKIMAG" as little endian integer
+const std::uint64_t IMAGE_MAGIC = 0x47414d494b42424f;
+
+const std::size_t INITIAL_FILE_SIZE = 1024 * 1024;
+
+const std::size_t CHECKED_OFFSET = offsetof(ImageHeader, sequence);
+
+std::string createImagePath(const std::string& path) {
+  auto directory = std::filesystem::path(path).parent_path();
+  if (!directory.empty()) {
+    std::filesystem::create_directories(directory);
+  }
+  return path;
+}
+
+template <typename LevelsType>
+char* writeLevels(char* output, const LevelsType& levels) {
+  for (const auto& level : levels) {
+    LevelRecord levelRecord{.price = level.price,
+                            .size = level.size,
+                            .sequence = level.sequence};
+    std::memcpy(output, &levelRecord, sizeof(levelRecord));
+    output += sizeof(levelRecord);
+  }
+  return output;
+}
+
+const char* readLevels(const char* input, std::uint32_t count,
+                       Levels& levels) {
+  levels.resize(count);
+  for (auto& level : levels) {
+    LevelRecord levelRecord;
+    std::memcpy(&levelRecord, input, sizeof(levelRecord));
+    input += sizeof(levelRecord);
+    level = {.price = levelRecord.price,
+             .size = levelRecord.size,
+             .sequence = levelRecord.sequence};
+  }
+  return input;
+}
+
+}  // namespace
+
+BookImage::BookImage(const std::string& path)
+    : m_file{createImagePath(path), MappedFile::Mode::READ_WRITE,
+             INITIAL_FILE_SIZE} {}
+
+void BookImage::save(const OrderBook& orderBook) {
+  const auto& bids = orderBook.getBids();
+  const auto& asks = orderBook.getAsks();
+  ImageHeader header{
+      .magic = IMAGE_MAGIC,
+      .version = IMAGE_FILE_VERSION,
+      .checksum = 0,
+      .sequence = orderBook.getSequence(),
+      .timestamp = orderBook.getLastUpdateTimestamp().count(),
+      .bidCount = static_cast<std::uint32_t>(std::size(bids)),
+      .askCount = static_cast<std::uint32_t>(std::size(asks))};
+  auto imageSize = sizeof(header) + (header.bidCount + header.askCount) *
+                                        sizeof(LevelRecord);
+  m_file.reserve(imageSize);
+  char* output = m_file.data() + sizeof(header);
+  output = writeLevels(output, bids | std::views::values);
+  writeLevels(output, asks | std::views::values);
+  std::memcpy(m_file.data(), &header, sizeof(header));
+  header.checksum = book_checksum::crc32(m_file.data() + CHECKED_OFFSET,
+                                         imageSize - CHECKED_OFFSET);
+  std::memcpy(m_file.data() + offsetof(ImageHeader, checksum),
+              &header.checksum, sizeof(header.checksum));
+}
+
+std::optional<OrderBookSnapshot> BookImage::load() const {
+  if (m_file.size() < sizeof(ImageHeader)) {
+    return std::nullopt;
+  }
+  ImageHeader header;
+  std::memcpy(&header, m_file.data(), sizeof(header));
+  if (header.magic != IMAGE_MAGIC) {
+    // never saved
+    return std::nullopt;
+  }
+  auto imageSize = sizeof(header) + (std::size_t(header.bidCount) +
+                                     header.askCount) *
+                                        sizeof(LevelRecord);
+  if (header.version != IMAGE_FILE_VERSION || imageSize > m_file.size() ||
+      header.checksum !=
+          book_checksum::crc32(m_file.data() + CHECKED_OFFSET,
+                               imageSize - CHECKED_OFFSET)) {
+    LOG_WARN("Book image '" << m_file.path()
+                            << "' is incomplete or of another version, "
+                               "ignoring it");
+    return std::nullopt;
+  }
+  OrderBookSnapshot orderBookSnapshot{
+      .sequence = header.sequence, .timestamp = TimePoint(header.timestamp)};
+  auto input = readLevels(m_file.data() + sizeof(header), header.bidCount,
+                          orderBookSnapshot.bids);
+  readLevels(input, header.askCount, orderBookSnapshot.asks);
+  return orderBookSnapshot;
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string>
+
+#include "MappedFile.h"
+#include "common_header.h"
+
+class OrderBook;
+
+namespace book_image {
+
+// followed by bidCount + askCount book_history::LevelRecords
+struct ImageHeader {
+  std::uint64_t magic;
+  std::uint32_t version;
+  // CRC32 of everything after this field, a save torn by a crash fails it
+  std::uint32_t checksum;
+  std::uint64_t sequence;
+  std::int64_t timestamp;
+  std::uint32_t bidCount;
+  std::uint32_t askCount;
+};
+
+}  // namespace book_image
+
+// Latest state of the book kept in one memory mapped file, rewritten in place
+// by every save. A restarted process loads it and goes live without a REST
+// snapshot when the feed continues the saved sequence.
+class BookImage {
+  MappedFile m_file;
+
+ public:
+  explicit BookImage(const std::string& path);
+
+  void save(const OrderBook& orderBook);
+  // Book of the last complete save, nothing when the file is new or the
+  // last save did not complete.
+  std::optional<OrderBookSnapshot> load() const;
+};
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <format>
+#include <map>
+#include <stdexcept>
+#include <string_view>
+
+// Assigns keys to nodes by hashing both onto a ring, a key belongs to the
+// first node point at or after its own hash. Every node owns many points
+// spread over the ring, so keys split evenly and removing a node only moves
+// the keys it owned, each to the node owning the next point.
+class ConsistentHashRing {
+  std::size_t m_pointsPerNode;
+  // point on the ring -> node
+  std::map<std::uint64_t, std::size_t> m_points;
+
+  // FNV-1a with a final mix, stable across processes and runs unlike
+  // std::hash, so gateway restarts assign the same symbols to each worker
+  static std::uint64_t hash(std::string_view key) {
+    std::uint64_t value = 0xcbf29ce484222325ULL;
+    for (auto c : key) {
+      value ^= static_cast<unsigned char>(c);
+      value *= 0x100000001b3ULL;
+    }
+    value ^= value >> 33;
+    value *= 0xff51afd7ed558ccdULL;
+    value ^= value >> 33;
+    return value;
+  }
+
+ public:
+  explicit ConsistentHashRing(std::size_t pointsPerNode = 64)
+      : m_pointsPerNode{pointsPerNode} {}
+
+  void addNode(std::size_t node) {
+    for (std::size_t point = 0; point < m_pointsPerNode; ++point) {
+      m_points.emplace(hash(std::format("node-{}#{}", node, point)), node);
+    }
+  }
+
+  void removeNode(std::size_t node) {
+    std::erase_if(m_points,
+                  [node](const auto& point) { return point.second == node; });
+  }
+
+  bool empty() const { return m_points.empty(); }
+
+  std::size_t nodeOf(std::string_view key) const {
+    if (m_points.empty()) {
+      throw std::runtime_error("Hash ring has no nodes");
+    }
+    auto pointIter = m_points.lower_bound(hash(key));
+    if (pointIter == m_points.end()) {
+      // wraps around
+      pointIter = m_points.begin();
+    }
+    return pointIter->second;
+  }
+};
@@ -0,0 +1,464 @@
+#pragma once
+
+#include <cctype>
+#include <charconv>
+#include <cstddef>
+#include <cstdint>
+#include <format>
+#include <nlohmann/json.hpp>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <variant>
+
+#include "common_header.h"
+#include "utils.h"
+
+// Everything venue specific about a feed is described by a schema type whose
+// field names, sequencing rule and level encoding are resolved at compile
+// time. FeedAdapter<Schema> turns it into a parser specialized for that venue,
+// the venue is picked once per connection through FeedAdapterVariant so the
+// per frame path has no runtime branching on the venue or virtual calls.
+namespace feed {
+
+using json = nlohmann::json;
+
+inline double parseDecimal(const json& jsonValue, std::string_view what) {
+  const auto& text = jsonValue.get_ref<const std::string&>();
+  double value{0};
+  auto [end, error] =
+      std::from_chars(text.data(), text.data() + std::size(text), value);
+  if (text.empty() || error != std::errc{} ||
+      end != text.data() + std::size(text)) {
+    throw std::runtime_error(std::format("Invalid {} '{}'", what, text));
+  }
+  return value;
+}
+
+// integer sent either as a json number or as a string
+template <typename Integer>
+Integer parseInteger(const json& jsonValue, std::string_view what) {
+  if (!jsonValue.is_string()) {
+    return jsonValue.get<Integer>();
+  }
+  const auto& text = jsonValue.get_ref<const std::string&>();
+  Integer value{0};
+  auto [end, error] =
+      std::from_chars(text.data(), text.data() + std::size(text), value);
+  if (text.empty() || error != std::errc{} ||
+      end != text.data() + std::size(text)) {
+    throw std::runtime_error(std::format("Invalid {} '{}'", what, text));
+  }
+  return value;
+}
+
+inline SequenceType parseSequence(const json& jsonValue) {
+  return parseInteger<SequenceType>(jsonValue, "sequence");
+}
+
+// Venues publish the CRC32 as a signed (OKX) or unsigned (Kraken) integer,
+// sometimes quoted, both map onto the same 32 bits.
+inline std::uint32_t parseChecksum(const json& jsonValue) {
+  if (!jsonValue.is_string()) {
+    return static_cast<std::uint32_t>(jsonValue.get<std::int64_t>());
+  }
+  const auto& text = jsonValue.get_ref<const std::string&>();
+  std::int64_t value{0};
+  auto [end, error] =
+      std::from_chars(text.data(), text.data() + std::size(text), value);
+  if (text.empty() || error != std::errc{} ||
+      end != text.data() + std::size(text)) {
+    throw std::runtime_error(std::format("Invalid checksum '{}'", text));
+  }
+  return static_cast<std::uint32_t>(value);
+}
+
+// Level encodings, how one price level is laid out in a levels array.
+
+// ["price", "size", "sequence"], every level carries its own sequence
+struct PriceSizeSequenceLevels {
+  static constexpr std::size_t FIELD_COUNT = 3;
+
+  static SequenceType levelSequence(const json& jsonLevel,
+                                    SequenceType /*updateSequence*/) {
+    return parseSequence(jsonLevel.at(2));
+  }
+};
+
+// ["price", "size"], levels take the last sequence of their update
+struct PriceSizeLevels {
+  static constexpr std::size_t FIELD_COUNT = 2;
+
+  static SequenceType levelSequence(const json& /*jsonLevel*/,
+                                    SequenceType updateSequence) {
+    return updateSequence;
+  }
+};
+
+// Sequencing rules, how an update tells where it sits in the stream. Both
+// map onto the [sequenceStart, sequenceEnd] range the book checks for gaps.
+
+// update carries its first and last sequence
+struct RangeSequencing {
+  template <typename Schema>
+  static void read(const json& update, IncrementalUpdate& incrementalUpdate) {
+    incrementalUpdate.sequenceStart =
+        parseSequence(update.at(Schema::FIRST_SEQUENCE));
+    incrementalUpdate.sequenceEnd =
+        parseSequence(update.at(Schema::LAST_SEQUENCE));
+  }
+};
+
+// update carries the last sequence of the previous update, chaining them
+struct PreviousIdSequencing {
+  template <typename Schema>
+  static void read(const json& update, IncrementalUpdate& incrementalUpdate) {
+    incrementalUpdate.sequenceStart =
+        parseSequence(update.at(Schema::PREVIOUS_SEQUENCE)) + 1;
+    incrementalUpdate.sequenceEnd =
+        parseSequence(update.at(Schema::LAST_SEQUENCE));
+  }
+};
+
+template <typename Schema>
+struct FeedAdapter {
+  static constexpr std::string_view NAME = Schema::NAME;
+  static constexpr std::string_view DEFAULT_SYMBOL = Schema::DEFAULT_SYMBOL;
+  static constexpr std::string_view WS_URI = Schema::WS_URI;
+  static constexpr bool MARKET_BY_ORDER = Schema::MARKET_BY_ORDER;
+
+  static std::string subscriptionRequest(std::string_view symbol) {
+    return Schema::subscriptionRequest(symbol);
+  }
+
+  static std::string snapshotUri(std::string_view symbol) {
+    return Schema::snapshotUri(symbol);
+  }
+
+  static void readChecksum(const json& payload,
+                           std::optional<std::uint32_t>& checksum) {
+    if constexpr (!Schema::CHECKSUM.empty()) {
+      if (auto checksumIter = payload.find(Schema::CHECKSUM);
+          checksumIter != payload.end()) {
+        checksum = parseChecksum(*checksumIter);
+      }
+    }
+  }
+
+  template <typename LevelEncoding>
+  static void parseLevels(const json& jsonLevels, SequenceType updateSequence,
+                          Levels& levels) {
+    levels.reserve(std::size(jsonLevels));
+    for (const auto& jsonLevel : jsonLevels) {
+      if (std::size(jsonLevel) != LevelEncoding::FIELD_COUNT) {
+        throw std::runtime_error(std::format(
+            "Expect {} elements in price level json array, but found {}, "
+            "input json array '{}'",
+            LevelEncoding::FIELD_COUNT, std::size(jsonLevel),
+            jsonLevel.dump()));
+      }
+      Level level{.price = parseDecimal(jsonLevel[0], "price"),
+                  .size = parseDecimal(jsonLevel[1], "size")};
+      if (priceCompareLessThan(level.price, 0)) {
+        throw std::runtime_error(
+            std::format("Price {} is less than 0", level.price));
+      }
+      if (sizeCompareLessThan(level.size, 0)) {
+        throw std::runtime_error(
+            std::format("Size {} is less than 0", level.size));
+      }
+      level.sequence = LevelEncoding::levelSequence(jsonLevel, updateSequence);
+      levels.push_back(level);
+    }
+  }
+
+  // Returns false for frames that are not book updates, e.g. subscription
+  // acknowledgements.
+  static bool parseIncrementalUpdate(std::string_view jsonData,
+                                     IncrementalUpdate& incrementalUpdate) {
+    auto root = json::parse(jsonData);
+    if (!Schema::isIncrementalUpdate(root)) {
+      return false;
+    }
+    const auto& update = Schema::updatePayload(root);
+    incrementalUpdate.timestamp =
+        TimePoint(update.at(Schema::UPDATE_TIME).template get<long>());
+    if constexpr (Schema::MARKET_BY_ORDER) {
+      Schema::readOrderEvent(root, update, incrementalUpdate);
+    } else {
+      Schema::Sequencing::template read<Schema>(update, incrementalUpdate);
+      using LevelEncoding = typename Schema::LevelEncoding;
+      const auto& changes = Schema::updateChanges(update);
+      parseLevels<LevelEncoding>(changes.at(Schema::UPDATE_BIDS),
+                                 incrementalUpdate.sequenceEnd,
+                                 incrementalUpdate.bids);
+      parseLevels<LevelEncoding>(changes.at(Schema::UPDATE_ASKS),
+                                 incrementalUpdate.sequenceEnd,
+                                 incrementalUpdate.asks);
+    }
+    readChecksum(update, incrementalUpdate.checksum);
+    return true;
+  }
+
+  static void parseSnapshot(std::string_view jsonData,
+                            OrderBookSnapshot& orderBookSnapshot) {
+    auto root = json::parse(jsonData);
+    const auto& snapshot = Schema::snapshotPayload(root);
+    if constexpr (!Schema::SNAPSHOT_TIME.empty()) {
+      orderBookSnapshot.timestamp =
+          TimePoint(snapshot.at(Schema::SNAPSHOT_TIME).template get<long>());
+    }
+    orderBookSnapshot.sequence =
+        parseSequence(snapshot.at(Schema::SNAPSHOT_SEQUENCE));
+    if constexpr (Schema::MARKET_BY_ORDER) {
+      // the book derives the levels from the orders
+      Schema::readSnapshotOrders(snapshot.at("bids"), BidOrAsk::BID,
+                                 orderBookSnapshot.orders);
+      Schema::readSnapshotOrders(snapshot.at("asks"), BidOrAsk::ASK,
+                                 orderBookSnapshot.orders);
+    } else {
+      // snapshot levels never carry a sequence of their own
+      parseLevels<PriceSizeLevels>(snapshot.at("bids"),
+                                   orderBookSnapshot.sequence,
+                                   orderBookSnapshot.bids);
+      parseLevels<PriceSizeLevels>(snapshot.at("asks"),
+                                   orderBookSnapshot.sequence,
+                                   orderBookSnapshot.asks);
+    }
+    readChecksum(snapshot, orderBookSnapshot.checksum);
+  }
+};
+
+// KuCoin level2 market data, updates are sequence ranges and every level
+// carries its own sequence.
+struct KucoinSchema {
+  using Sequencing = RangeSequencing;
+  using LevelEncoding = PriceSizeSequenceLevels;
+  static constexpr bool MARKET_BY_ORDER = false;
+
+  static constexpr std::string_view NAME = "kucoin";
+  static constexpr std::string_view DEFAULT_SYMBOL = "BTC-USDT";
+  static constexpr std::string_view WS_URI = "/ws";
+  static constexpr std::string_view UPDATE_TIME = "time";
+  static constexpr std::string_view FIRST_SEQUENCE = "sequenceStart";
+  static constexpr std::string_view LAST_SEQUENCE = "sequenceEnd";
+  static constexpr std::string_view UPDATE_BIDS = "bids";
+  static constexpr std::string_view UPDATE_ASKS = "asks";
+  static constexpr std::string_view SNAPSHOT_TIME = "time";
+  static constexpr std::string_view SNAPSHOT_SEQUENCE = "sequence";
+  // not part of KuCoin's feed, FeedSimulator adds it to updates and
+  // snapshots
+  static constexpr std::string_view CHECKSUM = "checksum";
+
+  static std::string subscriptionRequest(std::string_view symbol) {
+    return std::format(
+        "{{\"id\": 1545910660739, \"type\": \"subscribe\", "
+        "\"topic\": \"/market/level2:{}\", \"response\": true}}",
+        symbol);
+  }
+
+  static std::string snapshotUri(std::string_view symbol) {
+    return std::format("/snapshot?symbol={}", symbol);
+  }
+
+  static bool isIncrementalUpdate(const json& root) {
+    // welcome and ack frames have no data
+    return root.contains("data");
+  }
+
+  static const json& updatePayload(const json& root) { return root.at("data"); }
+
+  static const json& updateChanges(const json& update) {
+    return update.at("changes");
+  }
+
+  static const json& snapshotPayload(const json& root) {
+    return root.at("data");
+  }
+};
+
+// Binance spot diff depth stream, updates are id ranges (U..u) and levels
+// carry no sequence of their own.
+struct BinanceSchema {
+  using Sequencing = RangeSequencing;
+  using LevelEncoding = PriceSizeLevels;
+  static constexpr bool MARKET_BY_ORDER = false;
+
+  static constexpr std::string_view NAME = "binance";
+  static constexpr std::string_view DEFAULT_SYMBOL = "BTCUSDT";
+  static constexpr std::string_view WS_URI = "/ws";
+  static constexpr std::string_view UPDATE_TIME = "E";
+  static constexpr std::string_view FIRST_SEQUENCE = "U";
+  static constexpr std::string_view LAST_SEQUENCE = "u";
+  static constexpr std::string_view UPDATE_BIDS = "b";
+  static constexpr std::string_view UPDATE_ASKS = "a";
+  static constexpr std::string_view SNAPSHOT_TIME = "";
+  static constexpr std::string_view SNAPSHOT_SEQUENCE = "lastUpdateId";
+  static constexpr std::string_view CHECKSUM = "";
+
+  static std::string streamName(std::string_view symbol) {
+    std::string streamName;
+    for (auto c : symbol) {
+      streamName.push_back(static_cast<char>(
+          std::tolower(static_cast<unsigned char>(c))));
+    }
+    return streamName + "@depth@100ms";
+  }
+
+  static std::string subscriptionRequest(std::string_view symbol) {
+    return std::format(
+        "{{\"method\": \"SUBSCRIBE\", \"params\": [\"{}\"], \"id\": 1}}",
+        streamName(symbol));
+  }
+
+  static std::string snapshotUri(std::string_view symbol) {
+    return std::format("/api/v3/depth?symbol={}&limit=1000", symbol);
+  }
+
+  static bool isIncrementalUpdate(const json& root) {
+    // subscription responses look like {"result": null, "id": 1}
+    return root.contains("e");
+  }
+
+  static const json& updatePayload(const json& root) { return root; }
+
+  static const json& updateChanges(const json& update) { return update; }
+
+  static const json& snapshotPayload(const json& root) { return root; }
+};
+
+// Binance USD-M futures diff depth stream, each update names the last id of
+// the previous one (pu) instead of its own first id.
+struct BinanceFuturesSchema : BinanceSchema {
+  using Sequencing = PreviousIdSequencing;
+
+  static constexpr std::string_view NAME = "binance-futures";
+  static constexpr std::string_view PREVIOUS_SEQUENCE = "pu";
+  static constexpr std::string_view SNAPSHOT_TIME = "E";
+
+  static std::string snapshotUri(std::string_view symbol) {
+    return std::format("/fapi/v1/depth?symbol={}&limit=1000", symbol);
+  }
+};
+
+// Order level feed FeedSimulator --l3 serves, modelled on KuCoin's level3
+// channel: one order event per message, each with its own sequence, and
+// "open", "update" (new size) and "done" subjects. Order ids are numbers,
+// a venue with other ids would map them in its own schema.
+struct KucoinL3Schema {
+  static constexpr bool MARKET_BY_ORDER = true;
+
+  static constexpr std::string_view NAME = "kucoin-l3";
+  static constexpr std::string_view DEFAULT_SYMBOL = "BTC-USDT";
+  static constexpr std::string_view WS_URI = "/ws";
+  static constexpr std::string_view UPDATE_TIME = "ts";
+  static constexpr std::string_view SNAPSHOT_TIME = "time";
+  static constexpr std::string_view SNAPSHOT_SEQUENCE = "sequence";
+  static constexpr std::string_view CHECKSUM = "";
+
+  static std::string subscriptionRequest(std::string_view symbol) {
+    return std::format(
+        "{{\"id\": 1545910660740, \"type\": \"subscribe\", "
+        "\"topic\": \"/spotMarket/level3:{}\", \"response\": true}}",
+        symbol);
+  }
+
+  static std::string snapshotUri(std::string_view symbol) {
+    return std::format("/api/v3/market/orderbook/level3?symbol={}", symbol);
+  }
+
+  static bool isIncrementalUpdate(const json& root) {
+    return root.contains("data") && root.contains("subject");
+  }
+
+  static const json& updatePayload(const json& root) { return root.at("data"); }
+
+  static const json& snapshotPayload(const json& root) {
+    return root.at("data");
+  }
+
+  static BidOrAsk parseSide(const json& jsonSide) {
+    const auto& side = jsonSide.get_ref<const std::string&>();
+    if (side == "buy") {
+      return BidOrAsk::BID;
+    }
+    if (side == "sell") {
+      return BidOrAsk::ASK;
+    }
+    throw std::runtime_error(std::format("Invalid side '{}'", side));
+  }
+
+  static void readOrderEvent(const json& root, const json& update,
+                             IncrementalUpdate& incrementalUpdate) {
+    auto sequence = parseSequence(update.at("sequence"));
+    incrementalUpdate.sequenceStart = sequence;
+    incrementalUpdate.sequenceEnd = sequence;
+    const auto& subject = root.at("subject").get_ref<const std::string&>();
+    OrderEvent orderEvent{
+        .orderId = parseInteger<std::uint64_t>(update.at("orderId"),
+                                               "order id"),
+        .sequence = sequence};
+    if (subject == "open" || subject == "update") {
+      orderEvent.action =
+          subject == "open" ? OrderAction::ADD : OrderAction::MODIFY;
+      orderEvent.side = parseSide(update.at("side"));
+      orderEvent.price = parseDecimal(update.at("price"), "price");
+      orderEvent.size = parseDecimal(update.at("size"), "size");
+    } else if (subject == "done") {
+      orderEvent.action = OrderAction::REMOVE;
+    } else {
+      // other subjects still take a sequence, the update keeps the stream
+      // contiguous without touching the book
+      return;
+    }
+    incrementalUpdate.orders.push_back(orderEvent);
+  }
+
+  // [["orderId", "price", "size"], ...] in queue priority order
+  static void readSnapshotOrders(const json& jsonOrders, BidOrAsk side,
+                                 OrderEvents& orders) {
+    for (const auto& jsonOrder : jsonOrders) {
+      if (std::size(jsonOrder) != 3) {
+        throw std::runtime_error(std::format(
+            "Expect 3 elements in order json array, but found {}, input "
+            "json array '{}'",
+            std::size(jsonOrder), jsonOrder.dump()));
+      }
+      orders.push_back(
+          {.orderId = parseInteger<std::uint64_t>(jsonOrder[0], "order id"),
+           .side = side,
+           .price = parseDecimal(jsonOrder[1], "price"),
+           .size = parseDecimal(jsonOrder[2], "size")});
+    }
+  }
+};
+
+}  // namespace feed
+
+using KucoinFeedAdapter = feed::FeedAdapter<feed::KucoinSchema>;
+using BinanceFeedAdapter = feed::FeedAdapter<feed::BinanceSchema>;
+using BinanceFuturesFeedAdapter = feed::FeedAdapter<feed::BinanceFuturesSchema>;
+using KucoinL3FeedAdapter = feed::FeedAdapter<feed::KucoinL3Schema>;
+
+using FeedAdapterVariant =
+    std::variant<KucoinFeedAdapter, BinanceFeedAdapter,
+                 BinanceFuturesFeedAdapter, KucoinL3FeedAdapter>;
+
+// Throws for a name that matches none of the adapters.
+inline FeedAdapterVariant makeFeedAdapter(std::string_view name) {
+  if (name == KucoinFeedAdapter::NAME) {
+    return KucoinFeedAdapter{};
+  }
+  if (name == BinanceFeedAdapter::NAME) {
+    return BinanceFeedAdapter{};
+  }
+  if (name == BinanceFuturesFeedAdapter::NAME) {
+    return BinanceFuturesFeedAdapter{};
+  }
+  if (name == KucoinL3FeedAdapter::NAME) {
+    return KucoinL3FeedAdapter{};
+  }
+  throw std::runtime_error(std::format("Unknown feed '{}'", name));
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "common_header.h"
+
+// Collects incremental updates of frames that were already waiting in the
+// socket so they can be applied to the book under a single lock. With
+// conflation enabled, runs of contiguous updates are merged into one update
+// holding only the latest change per price.
+class IncrementalUpdateBatch {
+  bool m_conflate;
+  std::vector<IncrementalUpdate> m_updates;
+  // price -> position in the levels of the update being merged into, kept as
+  // members so the buckets are reused from batch to batch
+  std::unordered_map<PriceType, std::size_t> m_bidPositions;
+  std::unordered_map<PriceType, std::size_t> m_askPositions;
+
+  static void mergeLevels(Levels& levels,
+                          std::unordered_map<PriceType, std::size_t>& positions,
+                          Levels& inputLevels) {
+    for (auto& inputLevel : inputLevels) {
+      auto [positionIter, inserted] =
+          positions.try_emplace(inputLevel.price, std::size(levels));
+      if (inserted) {
+        levels.push_back(inputLevel);
+        continue;
+      }
+      auto& level = levels[positionIter->second];
+      if (inputLevel.sequence >= level.sequence) {
+        level = inputLevel;
+      }
+    }
+  }
+
+  void startMerge(IncrementalUpdate& incrementalUpdate) {
+    m_bidPositions.clear();
+    m_askPositions.clear();
+    for (std::size_t i = 0; i < std::size(incrementalUpdate.bids); ++i) {
+      m_bidPositions[incrementalUpdate.bids[i].price] = i;
+    }
+    for (std::size_t i = 0; i < std::size(incrementalUpdate.asks); ++i) {
+      m_askPositions[incrementalUpdate.asks[i].price] = i;
+    }
+  }
+
+ public:
+  explicit IncrementalUpdateBatch(bool conflate) : m_conflate{conflate} {}
+
+  void add(IncrementalUpdate&& incrementalUpdate) {
+    if (!m_conflate || m_updates.empty()) {
+      m_updates.push_back(std::move(incrementalUpdate));
+      if (m_conflate) {
+        startMerge(m_updates.back());
+      }
+      return;
+    }
+    auto& merged = m_updates.back();
+    if (incrementalUpdate.sequenceStart > merged.sequenceEnd + 1) {
+      // sequence gap, keep it visible to the book's gap detection
+      m_updates.push_back(std::move(incrementalUpdate));
+      startMerge(m_updates.back());
+      return;
+    }
+    mergeLevels(merged.bids, m_bidPositions, incrementalUpdate.bids);
+    mergeLevels(merged.asks, m_askPositions, incrementalUpdate.asks);
+    // order events can't be merged, every one moves a queue
+    merged.orders.insert(merged.orders.end(), incrementalUpdate.orders.begin(),
+                         incrementalUpdate.orders.end());
+    merged.sequenceEnd =
+        std::max(merged.sequenceEnd, incrementalUpdate.sequenceEnd);
+    merged.timestamp = incrementalUpdate.timestamp;
+    // the merged update leaves the book where the last one did
+    merged.checksum = incrementalUpdate.checksum;
+    merged.receiveTimestamp = incrementalUpdate.receiveTimestamp;
+  }
+
+  bool empty() const { return m_updates.empty(); }
+
+  std::size_t size() const { return std::size(m_updates); }
+
+  std::vector<IncrementalUpdate>& getUpdates() { return m_updates; }
+
+  void clear() { m_updates.clear(); }
+};
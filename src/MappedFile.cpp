@@ -0,0 +1,121 @@
+#include "MappedFile.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <format>
+#include <stdexcept>
+#include <utility>
+
+namespace {
+
+const std::size_t MAPPING_CHUNK_SIZE = 64 * 1024 * 1024;
+
+std::runtime_error systemError(std::string_view what, const std::string& path) {
+  return std::runtime_error(
+      std::format("{} '{}' failed: {}", what, path, std::strerror(errno)));
+}
+
+}  // namespace
+
+MappedFile::MappedFile(const std::string& path, Mode mode,
+                       std::size_t initialSize)
+    : m_path{path}, m_writable{mode == Mode::READ_WRITE} {
+  m_fd = m_writable ? ::open(path.c_str(), O_RDWR | O_CREAT, 0644)
+                    : ::open(path.c_str(), O_RDONLY);
+  if (m_fd < 0) {
+    throw systemError("open", path);
+  }
+  struct stat fileStat {};
+  if (::fstat(m_fd, &fileStat) != 0) {
+    ::close(m_fd);
+    throw systemError("fstat", path);
+  }
+  auto fileSize = static_cast<std::size_t>(fileStat.st_size);
+  try {
+    if (m_writable && fileSize < initialSize) {
+      reserve(initialSize);
+    } else if (fileSize > 0) {
+      map(fileSize);
+    }
+  } catch (...) {
+    ::close(m_fd);
+    throw;
+  }
+}
+
+MappedFile::MappedFile(MappedFile&& other) noexcept
+    : m_path{std::move(other.m_path)},
+      m_fd{std::exchange(other.m_fd, -1)},
+      m_data{std::exchange(other.m_data, nullptr)},
+      m_size{std::exchange(other.m_size, 0)},
+      m_writable{other.m_writable} {}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept {
+  if (this != &other) {
+    unmap();
+    if (m_fd >= 0) {
+      ::close(m_fd);
+    }
+    m_path = std::move(other.m_path);
+    m_fd = std::exchange(other.m_fd, -1);
+    m_data = std::exchange(other.m_data, nullptr);
+    m_size = std::exchange(other.m_size, 0);
+    m_writable = other.m_writable;
+  }
+  return *this;
+}
+
+MappedFile::~MappedFile() {
+  unmap();
+  if (m_fd >= 0) {
+    ::close(m_fd);
+  }
+}
+
+void MappedFile::map(std::size_t size) {
+  int protection = m_writable ? PROT_READ | PROT_WRITE : PROT_READ;
+  void* data = ::mmap(nullptr, size, protection, MAP_SHARED, m_fd, 0);
+  if (data == MAP_FAILED) {
+    throw systemError("mmap", m_path);
+  }
+  m_data = static_cast<char*>(data);
+  m_size = size;
+}
+
+void MappedFile::unmap() {
+  if (m_data != nullptr) {
+    ::munmap(m_data, m_size);
+    m_data = nullptr;
+    m_size = 0;
+  }
+}
+
+void MappedFile::reserve(std::size_t size) {
+  if (size <= m_size) {
+    return;
+  }
+  if (!m_writable) {
+    throw std::runtime_error(
+        std::format("Cannot grow read only mapping of '{}'", m_path));
+  }
+  auto newSize = (size + MAPPING_CHUNK_SIZE - 1) / MAPPING_CHUNK_SIZE *
+                 MAPPING_CHUNK_SIZE;
+  if (::ftruncate(m_fd, static_cast<off_t>(newSize)) != 0) {
+    throw systemError("ftruncate", m_path);
+  }
+  if (m_data == nullptr) {
+    map(newSize);
+    return;
+  }
+  void* data = ::mremap(m_data, m_size, newSize, MREMAP_MAYMOVE);
+  if (data == MAP_FAILED) {
+    throw systemError("mremap", m_path);
+  }
+  m_data = static_cast<char*>(data);
+  m_size = newSize;
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+// File mapped into memory with MAP_SHARED. A writable mapping grows in whole
+// chunks so appending does not need a remap for every record.
+class MappedFile {
+  std::string m_path;
+  int m_fd{-1};
+  char* m_data{nullptr};
+  std::size_t m_size{0};
+  bool m_writable{false};
+
+  void map(std::size_t size);
+  void unmap();
+
+ public:
+  enum struct Mode { READ_ONLY, READ_WRITE };
+
+  MappedFile() = default;
+  MappedFile(const std::string& path, Mode mode, std::size_t initialSize = 0);
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+  MappedFile(MappedFile&& other) noexcept;
+  MappedFile& operator=(MappedFile&& other) noexcept;
+  ~MappedFile();
+
+  // Makes sure at least `size` bytes are mapped, growing the file when
+  // needed. Pointers obtained from data() before the call become invalid.
+  void reserve(std::size_t size);
+
+  bool isOpen() const { return m_data != nullptr; }
+  char* data() { return m_data; }
+  const char* data() const { return m_data; }
+  std::size_t size() const { return m_size; }
+  const std::string& path() const { return m_path; }
+};
@@ -0,0 +1,327 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <optional>
+#include <utility>
+#include <vector>
+
+#include "common_header.h"
+#include "utils.h"
+
+// Order level (L3) side of the book. Every price level keeps its resting
+// orders in arrival order as an intrusive doubly linked FIFO, nodes come from
+// a pool and are found by order id through an open addressing index, so add,
+// modify and cancel are O(1) apart from the price level lookup. Each event
+// reports the new aggregated size of its level, which OrderBook applies like
+// any L2 change, the L2 view is never rebuilt from the orders.
+
+struct OrderQueue;
+
+struct OrderNode {
+  std::uint64_t orderId{0};
+  PriceType price{0};
+  SizeType size{0};
+  BidOrAsk side{BidOrAsk::BID};
+  OrderQueue* queue{nullptr};
+  // FIFO of the price level, `next` also links the pool's free list
+  OrderNode* prev{nullptr};
+  OrderNode* next{nullptr};
+};
+
+struct OrderQueue {
+  OrderNode* head{nullptr};
+  OrderNode* tail{nullptr};
+  SizeType size{0};
+  std::size_t orderCount{0};
+};
+
+// Hands out order nodes from fixed size chunks. Released nodes are reused
+// before a new chunk is allocated, once the book reached its usual size
+// order churn allocates nothing.
+class OrderNodePool {
+  static constexpr std::size_t CHUNK_SIZE = 4096;
+
+  std::vector<std::unique_ptr<OrderNode[]>> m_chunks;
+  // nodes of the last chunk handed out so far
+  std::size_t m_used{CHUNK_SIZE};
+  OrderNode* m_free{nullptr};
+
+ public:
+  OrderNode* allocate() {
+    if (m_free != nullptr) {
+      auto* node = std::exchange(m_free, m_free->next);
+      *node = {};
+      return node;
+    }
+    if (m_used == CHUNK_SIZE) {
+      m_chunks.push_back(std::make_unique<OrderNode[]>(CHUNK_SIZE));
+      m_used = 0;
+    }
+    return &m_chunks.back()[m_used++];
+  }
+
+  void release(OrderNode* node) { node->next = std::exchange(m_free, node); }
+
+  // Forgets every node, keeps the first chunk for the next book.
+  void clear() {
+    if (std::size(m_chunks) > 1) {
+      m_chunks.resize(1);
+    }
+    m_used = m_chunks.empty() ? CHUNK_SIZE : 0;
+    m_free = nullptr;
+  }
+};
+
+// Order id -> node, linear probing with backward shift deletion so erasing
+// leaves no tombstones behind to slow down later lookups.
+class OrderIndex {
+  struct Slot {
+    std::uint64_t orderId{0};
+    OrderNode* node{nullptr};
+  };
+
+  static constexpr std::size_t INITIAL_CAPACITY = 1024;
+
+  std::vector<Slot> m_slots{INITIAL_CAPACITY};
+  std::size_t m_size{0};
+
+  static std::size_t hash(std::uint64_t orderId) {
+    // ids are usually sequential, mix them before masking
+    orderId ^= orderId >> 33;
+    orderId *= 0xff51afd7ed558ccdULL;
+    orderId ^= orderId >> 33;
+    return static_cast<std::size_t>(orderId);
+  }
+
+  std::size_t mask() const { return std::size(m_slots) - 1; }
+
+  std::size_t slotOf(std::uint64_t orderId) const {
+    auto slot = hash(orderId) & mask();
+    while (m_slots[slot].node != nullptr &&
+           m_slots[slot].orderId != orderId) {
+      slot = (slot + 1) & mask();
+    }
+    return slot;
+  }
+
+  void grow() {
+    auto slots =
+        std::exchange(m_slots, std::vector<Slot>(std::size(m_slots) * 2));
+    for (const auto& slot : slots) {
+      if (slot.node != nullptr) {
+        m_slots[slotOf(slot.orderId)] = slot;
+      }
+    }
+  }
+
+ public:
+  OrderNode* find(std::uint64_t orderId) const {
+    return m_slots[slotOf(orderId)].node;
+  }
+
+  // `orderId` must not be indexed yet.
+  void insert(std::uint64_t orderId, OrderNode* node) {
+    // at most half full keeps probe sequences short
+    if ((m_size + 1) * 2 > std::size(m_slots)) {
+      grow();
+    }
+    m_slots[slotOf(orderId)] = {.orderId = orderId, .node = node};
+    ++m_size;
+  }
+
+  void erase(std::uint64_t orderId) {
+    auto hole = slotOf(orderId);
+    if (m_slots[hole].node == nullptr) {
+      return;
+    }
+    --m_size;
+    // pull back every following entry that may not stay behind the hole
+    for (auto slot = (hole + 1) & mask(); m_slots[slot].node != nullptr;
+         slot = (slot + 1) & mask()) {
+      auto home = hash(m_slots[slot].orderId) & mask();
+      bool reachable = hole <= slot ? (hole < home && home <= slot)
+                                    : (hole < home || home <= slot);
+      if (!reachable) {
+        m_slots[hole] = m_slots[slot];
+        hole = slot;
+      }
+    }
+    m_slots[hole] = {};
+  }
+
+  void clear() {
+    m_slots.assign(INITIAL_CAPACITY, {});
+    m_size = 0;
+  }
+
+  std::size_t size() const { return m_size; }
+};
+
+class MarketByOrderBook {
+  using BidQueues = std::map<PriceType, OrderQueue, PriceCompareGreaterThan>;
+  using AskQueues = std::map<PriceType, OrderQueue, PriceCompareLessThan>;
+
+  BidQueues m_bids;
+  AskQueues m_asks;
+  OrderNodePool m_pool;
+  OrderIndex m_index;
+
+  // An event may touch its level twice (replace an order in place), only
+  // the last size of the level counts.
+  static void report(Levels& levels, PriceType price, SizeType size,
+                     SequenceType sequence) {
+    if (!levels.empty() && levels.back().sequence == sequence &&
+        priceCompareEqual(levels.back().price, price)) {
+      levels.back().size = size;
+      return;
+    }
+    levels.push_back({.price = price, .size = size, .sequence = sequence});
+  }
+
+  template <typename Queues>
+  void add(Queues& queues, const OrderEvent& orderEvent, Levels& levels) {
+    auto& queue = queues[orderEvent.price];
+    auto* node = m_pool.allocate();
+    node->orderId = orderEvent.orderId;
+    node->price = orderEvent.price;
+    node->size = orderEvent.size;
+    node->side = orderEvent.side;
+    node->queue = &queue;
+    node->prev = queue.tail;
+    (queue.tail != nullptr ? queue.tail->next : queue.head) = node;
+    queue.tail = node;
+    queue.size += node->size;
+    ++queue.orderCount;
+    m_index.insert(node->orderId, node);
+    report(levels, node->price, queue.size, orderEvent.sequence);
+  }
+
+  template <typename Queues>
+  void remove(Queues& queues, OrderNode* node, SequenceType sequence,
+              Levels& levels) {
+    auto& queue = *node->queue;
+    (node->prev != nullptr ? node->prev->next : queue.head) = node->next;
+    (node->next != nullptr ? node->next->prev : queue.tail) = node->prev;
+    queue.size -= node->size;
+    auto price = node->price;
+    if (--queue.orderCount == 0) {
+      queues.erase(price);
+      report(levels, price, 0, sequence);
+    } else {
+      report(levels, price, queue.size, sequence);
+    }
+    m_index.erase(node->orderId);
+    m_pool.release(node);
+  }
+
+  void add(const OrderEvent& orderEvent, Levels& bids, Levels& asks) {
+    if (orderEvent.side == BidOrAsk::BID) {
+      add(m_bids, orderEvent, bids);
+    } else {
+      add(m_asks, orderEvent, asks);
+    }
+  }
+
+  void remove(OrderNode* node, SequenceType sequence, Levels& bids,
+              Levels& asks) {
+    if (node->side == BidOrAsk::BID) {
+      remove(m_bids, node, sequence, bids);
+    } else {
+      remove(m_asks, node, sequence, asks);
+    }
+  }
+
+  void apply(const OrderEvent& orderEvent, Levels& bids, Levels& asks) {
+    auto* node = m_index.find(orderEvent.orderId);
+    if (orderEvent.action == OrderAction::ADD) {
+      if (node != nullptr) {
+        // a repeated add replaces the order, like a modify losing priority
+        remove(node, orderEvent.sequence, bids, asks);
+      }
+      add(orderEvent, bids, asks);
+      return;
+    }
+    if (node == nullptr) {
+      // venues announce the end of taker orders that never rested
+      return;
+    }
+    if (orderEvent.action == OrderAction::REMOVE ||
+        sizeCompareEqual(orderEvent.size, 0)) {
+      remove(node, orderEvent.sequence, bids, asks);
+      return;
+    }
+    if (node->side != orderEvent.side ||
+        !priceCompareEqual(node->price, orderEvent.price)) {
+      // moving to another price goes to the back of that level's queue
+      remove(node, orderEvent.sequence, bids, asks);
+      add(orderEvent, bids, asks);
+      return;
+    }
+    // size changes keep the order's place in the queue
+    node->queue->size += orderEvent.size - node->size;
+    node->size = orderEvent.size;
+    report(node->side == BidOrAsk::BID ? bids : asks, node->price,
+           node->queue->size, orderEvent.sequence);
+  }
+
+  template <typename Queues>
+  static void collectOrderCounts(const Queues& queues, std::size_t depth,
+                                 OrderCountLevels& output) {
+    for (const auto& [price, queue] : queues) {
+      if (depth != 0 && std::size(output) >= depth) {
+        break;
+      }
+      output.push_back({.price = price,
+                        .size = queue.size,
+                        .orderCount = queue.orderCount});
+    }
+  }
+
+ public:
+  // Applies `orderEvents` in order and appends the new aggregated size of
+  // each level they touched to `bids` and `asks`, 0 for levels that emptied.
+  void apply(const OrderEvents& orderEvents, Levels& bids, Levels& asks) {
+    for (const auto& orderEvent : orderEvents) {
+      apply(orderEvent, bids, asks);
+    }
+  }
+
+  void clear() {
+    m_bids.clear();
+    m_asks.clear();
+    m_index.clear();
+    m_pool.clear();
+  }
+
+  std::size_t getOrderCount() const { return m_index.size(); }
+
+  std::optional<QueuePosition> getQueuePosition(std::uint64_t orderId) const {
+    const auto* node = m_index.find(orderId);
+    if (node == nullptr) {
+      return std::nullopt;
+    }
+    QueuePosition queuePosition{.orderId = orderId,
+                                .side = node->side,
+                                .price = node->price,
+                                .size = node->size,
+                                .levelOrderCount = node->queue->orderCount,
+                                .levelSize = node->queue->size};
+    for (const auto* ahead = node->queue->head; ahead != node;
+         ahead = ahead->next) {
+      ++queuePosition.ordersAhead;
+      queuePosition.sizeAhead += ahead->size;
+    }
+    return queuePosition;
+  }
+
+  // Copies the top `depth` levels of each side with their order counts, 0
+  // means full depth.
+  void getOrderCountLevels(std::size_t depth, OrderCountLevels& bids,
+                           OrderCountLevels& asks) const {
+    collectOrderCounts(m_bids, depth, bids);
+    collectOrderCounts(m_asks, depth, asks);
+  }
+};
@@ -3,11 +3,22 @@
 #include <algorithm>
 #include <chrono>
 #include <cstddef>
+#include <cstdint>
+#include <format>
 #include <limits>
 #include <map>
+#include <memory>
+#include <optional>
 #include <queue>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
 #include <vector>
 
+#include "BookChecksum.hpp"
+#include "MarketByOrder.hpp"
+#include "PriceBuckets.hpp"
 #include "common_header.h"
 #include "logging.h"
 #include "utils.h"
@@ -16,29 +27,173 @@ class OrderBook {
   SequenceType m_sequence{0};
   TimePoint m_lastUpdateTimestamp;
   bool m_snapshotReceived{false};
+  // restored from a saved image, live once the feed continues its sequence
+  bool m_restored{false};
+  // set once an update skipped sequences, the book can't recover by itself
+  bool m_sequenceGap{false};
+  // set once the book disagreed with a checksum published by the feed
+  bool m_checksumMismatch{false};
+  // levels per side covered by the checksum, 0 disables it
+  std::size_t m_checksumDepth{book_checksum::DEFAULT_DEPTH};
+  // computed on demand, the top of the book changes far more often than it
+  // is verified or served
+  mutable bool m_checksumDirty{true};
+  mutable std::uint32_t m_checksum{0};
+  mutable std::string m_checksumText;
   BidLevels m_bids;
   AskLevels m_asks;
   std::queue<IncrementalUpdate> m_pendingIncrementalUpdates;
+  std::vector<PriceBucketView> m_bucketViews;
+  // orders behind the levels for market by order feeds, null for L2 feeds
+  std::unique_ptr<MarketByOrderBook> m_marketByOrder;
+  // last published best bid and ask
+  TopOfBook m_topOfBook;
+  // set by level changes at or through the published top, only then the
+  // new top is read and compared once the update is applied
+  bool m_topTouched{false};
+  std::vector<TopOfBookCallback> m_topOfBookCallbacks;
+
+  bool touchesTop(BidOrAsk bidOrAsk, PriceType price) const {
+    if (bidOrAsk == BidOrAsk::BID) {
+      return sizeCompareEqual(m_topOfBook.bidSize, 0) ||
+             !priceCompareLessThan(price, m_topOfBook.bidPrice);
+    }
+    return sizeCompareEqual(m_topOfBook.askSize, 0) ||
+           !priceCompareGreaterThan(price, m_topOfBook.askPrice);
+  }
+
+  // Calls the top of book callbacks when the update that just got applied
+  // changed the best bid or ask, map begin() is constant time so no side is
+  // rescanned.
+  void publishTopOfBook(std::chrono::nanoseconds receiveTimestamp) {
+    if (!m_topTouched) {
+      return;
+    }
+    m_topTouched = false;
+    auto [bidPrice, bidSize] = bestOf(m_bids);
+    auto [askPrice, askSize] = bestOf(m_asks);
+    if (priceCompareEqual(bidPrice, m_topOfBook.bidPrice) &&
+        sizeCompareEqual(bidSize, m_topOfBook.bidSize) &&
+        priceCompareEqual(askPrice, m_topOfBook.askPrice) &&
+        sizeCompareEqual(askSize, m_topOfBook.askSize)) {
+      return;
+    }
+    m_topOfBook = {.sequence = m_sequence,
+                   .timestamp = m_lastUpdateTimestamp,
+                   .receiveTimestamp = receiveTimestamp,
+                   .bidPrice = bidPrice,
+                   .bidSize = bidSize,
+                   .askPrice = askPrice,
+                   .askSize = askSize};
+    for (const auto& topOfBookCallback : m_topOfBookCallbacks) {
+      topOfBookCallback(m_topOfBook);
+    }
+  }
+
+  template <typename LevelType>
+  static std::pair<PriceType, SizeType> bestOf(const LevelType& levels) {
+    if (levels.empty()) {
+      return {0, 0};
+    }
+    const auto& level = levels.begin()->second;
+    return {level.price, level.size};
+  }
+
+  // Single place every level mutation is reported to, keeps derived views in
+  // step with the raw levels without rescanning them.
+  void onLevelChange(BidOrAsk bidOrAsk, PriceType price, SizeType oldSize,
+                     SizeType newSize) {
+    m_checksumDirty = true;
+    if (!m_topTouched && touchesTop(bidOrAsk, price)) {
+      m_topTouched = true;
+    }
+    for (auto& bucketView : m_bucketViews) {
+      bucketView.onLevelChange(bidOrAsk, price, oldSize, newSize);
+    }
+  }
+
+  void clear() {
+    for (const auto& [price, level] : m_bids) {
+      onLevelChange(BidOrAsk::BID, price, level.size, 0);
+    }
+    for (const auto& [price, level] : m_asks) {
+      onLevelChange(BidOrAsk::ASK, price, level.size, 0);
+    }
+    m_bids.clear();
+    m_asks.clear();
+    m_sequence = 0;
+    m_lastUpdateTimestamp = TimePoint{0};
+  }
+
+  template <typename LevelType>
+  static constexpr BidOrAsk sideOf() {
+    return std::is_same_v<LevelType, BidLevels> ? BidOrAsk::BID
+                                                : BidOrAsk::ASK;
+  }
+
+  template <typename LevelType>
+  static void collectLevels(const LevelType& levels, std::size_t depth,
+                            Levels& output) {
+    output.reserve(depth == 0 ? std::size(levels)
+                              : std::min(depth, std::size(levels)));
+    for (const auto& level : levels) {
+      if (depth != 0 && std::size(output) >= depth) {
+        break;
+      }
+      output.push_back(level.second);
+    }
+  }
 
  public:
+  OrderBook() = default;
+
+  explicit OrderBook(const std::vector<PriceType>& bucketSizes,
+                     std::size_t checksumDepth = book_checksum::DEFAULT_DEPTH,
+                     bool marketByOrder = false)
+      : m_checksumDepth{checksumDepth},
+        m_marketByOrder{marketByOrder ? std::make_unique<MarketByOrderBook>()
+                                      : nullptr} {
+    m_bucketViews.reserve(std::size(bucketSizes));
+    for (auto bucketSize : bucketSizes) {
+      m_bucketViews.emplace_back(bucketSize);
+    }
+  }
+
   void applySnapshot(OrderBookSnapshot&& orderBookSnapshot) {
     m_snapshotReceived = true;
+    // Everything up to the snapshot sequence is already in the snapshot,
+    // buffered updates only contribute the levels that are newer.
+    m_sequence = orderBookSnapshot.sequence;
+    m_lastUpdateTimestamp = orderBookSnapshot.timestamp;
+    if (m_marketByOrder) {
+      deriveSnapshotLevels(orderBookSnapshot);
+    }
     for (auto& level : orderBookSnapshot.bids) {
       level.sequence = m_sequence;
-      m_bids[level.price] = level;
+      auto& bid = m_bids[level.price];
+      onLevelChange(BidOrAsk::BID, level.price, bid.size, level.size);
+      bid = level;
     }
     for (auto& level : orderBookSnapshot.asks) {
       level.sequence = m_sequence;
-      m_asks[level.price] = level;
+      auto& ask = m_asks[level.price];
+      onLevelChange(BidOrAsk::ASK, level.price, ask.size, level.size);
+      ask = level;
+    }
+    if (orderBookSnapshot.checksum) {
+      verifyChecksum(*orderBookSnapshot.checksum, m_sequence);
     }
 
     while (!m_pendingIncrementalUpdates.empty()) {
-      applyIncrementalUpdate(std::move(m_pendingIncrementalUpdates.front()));
+      auto& pendingIncrementalUpdate = m_pendingIncrementalUpdates.front();
+      if (pendingIncrementalUpdate.sequenceEnd > m_sequence) {
+        applyIncrementalUpdate(std::move(pendingIncrementalUpdate));
+      }
       m_pendingIncrementalUpdates.pop();
     }
-
-    m_lastUpdateTimestamp = orderBookSnapshot.timestamp;
-    m_sequence = orderBookSnapshot.sequence;
+    // unless a buffered update published it already
+    publishTopOfBook(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::system_clock::now().time_since_epoch()));
   }
 
   template <typename LevelType>
@@ -48,11 +203,19 @@ class OrderBook {
         continue;
       }
       if (sizeCompareEqual(inputLevel.size, 0)) {
-        levels.erase(inputLevel.price);
+        auto levelIter = levels.find(inputLevel.price);
+        if (levelIter != levels.end()) {
+          onLevelChange(sideOf<LevelType>(), levelIter->second.price,
+                        levelIter->second.size, 0);
+          levels.erase(levelIter);
+        }
         continue;
       }
       auto insertResult = levels.insert({inputLevel.price, inputLevel});
-      if (!insertResult.second) {
+      if (insertResult.second) {
+        onLevelChange(sideOf<LevelType>(), inputLevel.price, 0,
+                      inputLevel.size);
+      } else {
         auto& level = insertResult.first->second;
         if (inputLevel.sequence <= level.sequence) {
           continue;
@@ -62,6 +225,8 @@ class OrderBook {
           level.sequence = inputLevel.sequence;
           continue;
         }
+        onLevelChange(sideOf<LevelType>(), level.price, level.size,
+                      inputLevel.size);
         level.sequence = inputLevel.sequence;
         level.size = inputLevel.size;
         level.price = inputLevel.price;
@@ -69,7 +234,60 @@ class OrderBook {
     }
   }
 
+  // Replaces the snapshot's levels with the ones its orders add up to.
+  void deriveSnapshotLevels(OrderBookSnapshot& orderBookSnapshot) {
+    m_marketByOrder->clear();
+    for (auto& order : orderBookSnapshot.orders) {
+      order.action = OrderAction::ADD;
+      order.sequence = orderBookSnapshot.sequence;
+    }
+    Levels bids;
+    Levels asks;
+    m_marketByOrder->apply(orderBookSnapshot.orders, bids, asks);
+    orderBookSnapshot.bids.clear();
+    orderBookSnapshot.asks.clear();
+    OrderCountLevels bidCounts;
+    OrderCountLevels askCounts;
+    m_marketByOrder->getOrderCountLevels(0, bidCounts, askCounts);
+    for (const auto& level : bidCounts) {
+      orderBookSnapshot.bids.push_back(
+          {.price = level.price, .size = level.size});
+    }
+    for (const auto& level : askCounts) {
+      orderBookSnapshot.asks.push_back(
+          {.price = level.price, .size = level.size});
+    }
+  }
+
+  // Loads a book saved by an earlier run. It is served right away but only
+  // counts as synchronized once the first update continues its sequence,
+  // otherwise it is dropped and the book waits for a snapshot as usual.
+  void restoreImage(OrderBookSnapshot&& orderBookSnapshot) {
+    if (m_marketByOrder) {
+      LOG_WARN("Book images hold no orders, market by order books start "
+               "from a snapshot");
+      return;
+    }
+    applySnapshot(std::move(orderBookSnapshot));
+    m_snapshotReceived = false;
+    m_restored = true;
+  }
+
   bool applyIncrementalUpdate(IncrementalUpdate&& incrementalUpdate) {
+    if (m_restored) {
+      m_restored = false;
+      if (incrementalUpdate.sequenceStart <= m_sequence + 1 &&
+          incrementalUpdate.sequenceEnd > m_sequence) {
+        LOG_INFO("Feed continues the restored book at sequence "
+                 << m_sequence << ", no snapshot needed");
+        m_snapshotReceived = true;
+      } else {
+        LOG_INFO("Restored book at sequence "
+                 << m_sequence << " is stale, feed is at "
+                 << incrementalUpdate.sequenceStart);
+        clear();
+      }
+    }
     if (!m_snapshotReceived) {
       // snapshot not received yet
       if (std::size(m_pendingIncrementalUpdates) == 0) {
@@ -83,6 +301,7 @@ class OrderBook {
       LOG_WARN("Invalid sequenceStart " << incrementalUpdate.sequenceStart
                                         << " received, existing sequenceEnd is "
                                         << m_sequence);
+      m_sequenceGap = true;
       return false;
     }
     if (incrementalUpdate.sequenceEnd <= m_sequence) {
@@ -91,13 +310,37 @@ class OrderBook {
                                       << m_sequence);
       return false;
     }
+    if (m_marketByOrder) {
+      m_marketByOrder->apply(incrementalUpdate.orders, incrementalUpdate.bids,
+                             incrementalUpdate.asks);
+    }
     applyLevels(incrementalUpdate.bids, m_bids);
     applyLevels(incrementalUpdate.asks, m_asks);
     m_lastUpdateTimestamp = incrementalUpdate.timestamp;
     m_sequence = incrementalUpdate.sequenceEnd;
+    publishTopOfBook(incrementalUpdate.receiveTimestamp);
+    if (incrementalUpdate.checksum) {
+      verifyChecksum(*incrementalUpdate.checksum, m_sequence);
+    }
     return true;
   }
 
+  // Compares the book with a checksum the feed published for it, the book
+  // only reports the mismatch, recovering needs a new snapshot.
+  bool verifyChecksum(std::uint32_t expected, SequenceType sequence) {
+    if (m_checksumDepth == 0 || m_checksumMismatch) {
+      return !m_checksumMismatch;
+    }
+    auto checksum = getChecksum();
+    if (checksum != expected) {
+      LOG_WARN("Checksum mismatch at sequence "
+               << sequence << ", book has " << checksum << ", feed has "
+               << expected);
+      m_checksumMismatch = true;
+    }
+    return !m_checksumMismatch;
+  }
+
   void printTop10() const {
     std::cout << "========================================\n";
     std::cout << "  ******* *******  ASKs ******* ******* \n";
@@ -142,7 +385,72 @@ class OrderBook {
 
   bool isSnapshotReceived() const { return m_snapshotReceived; }
 
+  bool hasSequenceGap() const { return m_sequenceGap; }
+
+  bool hasChecksumMismatch() const { return m_checksumMismatch; }
+
+  std::size_t getChecksumDepth() const { return m_checksumDepth; }
+
+  // CRC32 of the top getChecksumDepth() levels, see BookChecksum.hpp.
+  std::uint32_t getChecksum() const {
+    if (m_checksumDirty) {
+      m_checksum = book_checksum::compute(m_bids, m_asks, m_checksumDepth,
+                                          m_checksumText);
+      m_checksumDirty = false;
+    }
+    return m_checksum;
+  }
+
   const BidLevels& getBids() const { return m_bids; }
 
   const AskLevels& getAsks() const { return m_asks; }
+
+  // Copies the top `depth` levels of each side, 0 means full depth.
+  void getLevels(std::size_t depth, Levels& bids, Levels& asks) const {
+    collectLevels(m_bids, depth, bids);
+    collectLevels(m_asks, depth, asks);
+  }
+
+  // Registers a callback run whenever the best bid or ask changes, see
+  // TopOfBookCallback.
+  void addTopOfBookCallback(TopOfBookCallback topOfBookCallback) {
+    m_topOfBookCallbacks.push_back(std::move(topOfBookCallback));
+  }
+
+  const TopOfBook& getTopOfBook() const { return m_topOfBook; }
+
+  bool isMarketByOrder() const { return !!m_marketByOrder; }
+
+  // Levels with the number of orders resting at each, market by order books
+  // only.
+  void getOrderCountLevels(std::size_t depth, OrderCountLevels& bids,
+                           OrderCountLevels& asks) const {
+    if (!m_marketByOrder) {
+      throw std::runtime_error("Order counts need a market by order feed");
+    }
+    m_marketByOrder->getOrderCountLevels(depth, bids, asks);
+  }
+
+  std::optional<QueuePosition> getQueuePosition(std::uint64_t orderId) const {
+    if (!m_marketByOrder) {
+      throw std::runtime_error("Queue positions need a market by order feed");
+    }
+    auto queuePosition = m_marketByOrder->getQueuePosition(orderId);
+    if (queuePosition) {
+      queuePosition->sequence = m_sequence;
+    }
+    return queuePosition;
+  }
+
+  void getBucketLevels(PriceType bucketSize, std::size_t depth,
+                       BucketLevels& bids, BucketLevels& asks) const {
+    for (const auto& bucketView : m_bucketViews) {
+      if (priceCompareEqual(bucketView.getBucketSize(), bucketSize)) {
+        bucketView.getLevels(depth, bids, asks);
+        return;
+      }
+    }
+    throw std::runtime_error(
+        std::format("Price bucket {} is not configured", bucketSize));
+  }
 };
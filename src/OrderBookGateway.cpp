@@ -0,0 +1,420 @@
+#include "OrderBookGateway.h"
+
+#include <signal.h>
+#include <spawn.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <boost_http_server/reply.hpp>
+#include <boost_http_server/request.hpp>
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <format>
+#include <nlohmann/json.hpp>
+#include <stdexcept>
+#include <utility>
+
+#include "logging.h"
+#include "utils.h"
+
+extern char** environ;
+
+namespace {
+
+class SocketGuard {
+  int m_fd;
+
+ public:
+  explicit SocketGuard(int fd) : m_fd{fd} {}
+  SocketGuard(const SocketGuard&) = delete;
+  SocketGuard& operator=(const SocketGuard&) = delete;
+  ~SocketGuard() { ::close(m_fd); }
+};
+
+std::string join(const std::vector<std::string>& values) {
+  std::string joined;
+  for (const auto& value : values) {
+    if (!joined.empty()) {
+      joined.push_back(',');
+    }
+    joined += value;
+  }
+  return joined;
+}
+
+// Sends `request` to the http server listening on the Unix socket
+// `socketPath` and returns the whole reply, it closes the connection after
+// one reply. Plain blocking POSIX calls so the socket timeouts hold, a hung
+// worker costs at most `timeout` per request.
+std::string exchange(const std::string& socketPath, std::string_view request,
+                     std::chrono::milliseconds timeout) {
+  sockaddr_un address{};
+  address.sun_family = AF_UNIX;
+  if (std::size(socketPath) >= sizeof(address.sun_path)) {
+    throw std::runtime_error(
+        std::format("socket path '{}' is too long", socketPath));
+  }
+  std::memcpy(address.sun_path, socketPath.c_str(), std::size(socketPath));
+  int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0) {
+    throw std::runtime_error(
+        std::format("socket failed: {}", std::strerror(errno)));
+  }
+  SocketGuard socketGuard(fd);
+  timeval timeoutValue{
+      .tv_sec = static_cast<time_t>(timeout.count() / 1000),
+      .tv_usec = static_cast<suseconds_t>(timeout.count() % 1000 * 1000)};
+  ::setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeoutValue,
+               sizeof(timeoutValue));
+  ::setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeoutValue,
+               sizeof(timeoutValue));
+  if (::connect(fd, reinterpret_cast<const sockaddr*>(&address),
+                sizeof(address)) != 0) {
+    throw std::runtime_error(std::format("connect to '{}' failed: {}",
+                                         socketPath, std::strerror(errno)));
+  }
+  while (!request.empty()) {
+    auto sent = ::send(fd, request.data(), std::size(request), MSG_NOSIGNAL);
+    if (sent < 0) {
+      throw std::runtime_error(std::format("send to '{}' failed: {}",
+                                           socketPath, std::strerror(errno)));
+    }
+    request.remove_prefix(static_cast<std::size_t>(sent));
+  }
+  std::string response;
+  char buffer[16384];
+  while (true) {
+    auto received = ::recv(fd, buffer, sizeof(buffer), 0);
+    if (received < 0) {
+      throw std::runtime_error(std::format("receive from '{}' failed: {}",
+                                           socketPath, std::strerror(errno)));
+    }
+    if (received == 0) {
+      return response;
+    }
+    response.append(buffer, static_cast<std::size_t>(received));
+  }
+}
+
+std::string_view getHeader(const http::server::request& req,
+                           std::string_view name) {
+  for (const auto& header : req.headers) {
+    if (caseInsensitiveEqual(header.name, name)) {
+      return header.value;
+    }
+  }
+  return {};
+}
+
+}  // namespace
+
+OrderBookGateway::OrderBookGateway(GatewayOptions options)
+    : m_options{std::move(options)},
+      m_childSignals{m_ioc, SIGCHLD},
+      m_stopSignals{m_ioc, SIGINT, SIGTERM} {
+  if (m_options.symbols.empty()) {
+    throw std::runtime_error("Gateway needs at least one symbol");
+  }
+  std::filesystem::create_directories(m_options.socketDirectory);
+  m_workers.resize(m_options.workerCount);
+  for (std::size_t id = 0; id < m_options.workerCount; ++id) {
+    auto& worker = m_workers[id];
+    worker.id = id;
+    worker.socketPath =
+        (std::filesystem::path(m_options.socketDirectory) /
+         std::format("worker-{}.sock", id))
+            .string();
+    worker.restartTimer = std::make_unique<boost::asio::steady_timer>(m_ioc);
+    m_ring.addNode(id);
+  }
+  assignSymbols();
+}
+
+OrderBookGateway::~OrderBookGateway() {
+  if (!m_stopping) {
+    stop();
+  }
+}
+
+void OrderBookGateway::assignSymbols() {
+  std::lock_guard lock(m_routesMutex);
+  for (auto& worker : m_workers) {
+    worker.symbols.clear();
+  }
+  m_routes.clear();
+  for (const auto& symbol : m_options.symbols) {
+    auto& worker = m_workers[m_ring.nodeOf(symbol)];
+    worker.symbols.push_back(symbol);
+    m_routes[symbol] = worker.socketPath;
+  }
+}
+
+void OrderBookGateway::spawn(Worker& worker) {
+  if (worker.symbols.empty()) {
+    LOG_INFO("Worker " << worker.id << " owns no symbols, not started");
+    return;
+  }
+  std::vector<std::string> arguments{m_options.orderBookPath};
+  arguments.insert(arguments.end(), m_options.workerArguments.begin(),
+                   m_options.workerArguments.end());
+  arguments.insert(arguments.end(),
+                   {"--symbol", join(worker.symbols), "--http_server_socket",
+                    worker.socketPath});
+  std::vector<char*> argv;
+  for (auto& argument : arguments) {
+    argv.push_back(argument.data());
+  }
+  argv.push_back(nullptr);
+  pid_t pid;
+  if (auto error = posix_spawn(&pid, m_options.orderBookPath.c_str(), nullptr,
+                               nullptr, argv.data(), environ);
+      error != 0) {
+    throw std::runtime_error(std::format("Cannot start worker '{}': {}",
+                                         m_options.orderBookPath,
+                                         std::strerror(error)));
+  }
+  LOG_INFO("Worker " << worker.id << " started, pid " << pid << ", symbols "
+                     << join(worker.symbols));
+  std::lock_guard lock(m_routesMutex);
+  worker.pid = pid;
+}
+
+void OrderBookGateway::terminate(Worker& worker) {
+  if (worker.pid > 0) {
+    ::kill(worker.pid, SIGTERM);
+  }
+}
+
+void OrderBookGateway::waitForChildren() {
+  m_childSignals.async_wait([this](boost::system::error_code ec, int) {
+    if (ec) {
+      return;
+    }
+    // one SIGCHLD may stand for several exits
+    int status;
+    pid_t pid;
+    while ((pid = ::waitpid(-1, &status, WNOHANG)) > 0) {
+      for (auto& worker : m_workers) {
+        if (worker.pid == pid) {
+          onWorkerExit(worker, status);
+          break;
+        }
+      }
+    }
+    waitForChildren();
+  });
+}
+
+void OrderBookGateway::onWorkerExit(Worker& worker, int status) {
+  {
+    std::lock_guard lock(m_routesMutex);
+    worker.pid = -1;
+  }
+  if (m_stopping) {
+    return;
+  }
+  if (std::exchange(worker.respawn, false)) {
+    spawn(worker);
+    return;
+  }
+  LOG_WARN("Worker " << worker.id << " ("
+                     << join(worker.symbols) << ") "
+                     << (WIFSIGNALED(status)
+                             ? std::format("killed by signal {}",
+                                           WTERMSIG(status))
+                             : std::format("exited with status {}",
+                                           WEXITSTATUS(status))));
+  auto now = std::chrono::steady_clock::now();
+  worker.recentExits.push_back(now);
+  while (worker.recentExits.front() < now - m_options.restartWindow) {
+    worker.recentExits.pop_front();
+  }
+  if (std::size(worker.recentExits) > m_options.maxRestarts) {
+    retire(worker);
+    return;
+  }
+  worker.restartTimer->expires_after(m_options.restartDelay);
+  worker.restartTimer->async_wait([this, &worker](
+                                      boost::system::error_code ec) {
+    if (!ec && !m_stopping && !worker.retired && worker.pid < 0) {
+      {
+        std::lock_guard lock(m_routesMutex);
+        ++worker.restarts;
+      }
+      spawn(worker);
+    }
+  });
+}
+
+void OrderBookGateway::retire(Worker& worker) {
+  LOG_ERROR("Worker " << worker.id << " exited "
+                      << std::size(worker.recentExits) << " times within "
+                      << m_options.restartWindow.count()
+                      << " ms, moving its symbols to the other workers");
+  {
+    std::lock_guard lock(m_routesMutex);
+    worker.retired = true;
+  }
+  m_ring.removeNode(worker.id);
+  if (m_ring.empty()) {
+    LOG_ERROR("No workers left, symbols are not served anymore");
+    std::lock_guard lock(m_routesMutex);
+    worker.symbols.clear();
+    m_routes.clear();
+    return;
+  }
+  std::vector<std::vector<std::string>> previousSymbols;
+  for (const auto& other : m_workers) {
+    previousSymbols.push_back(other.symbols);
+  }
+  assignSymbols();
+  // only the workers that received symbols restart, the ring leaves every
+  // other shard as it was
+  for (auto& other : m_workers) {
+    if (other.retired || other.symbols == previousSymbols[other.id]) {
+      continue;
+    }
+    if (other.pid > 0) {
+      other.respawn = true;
+      terminate(other);
+    } else {
+      spawn(other);
+    }
+  }
+}
+
+void OrderBookGateway::stop() {
+  m_stopping = true;
+  for (auto& worker : m_workers) {
+    worker.restartTimer->cancel();
+    terminate(worker);
+  }
+  for (auto& worker : m_workers) {
+    if (worker.pid > 0) {
+      int status;
+      ::waitpid(worker.pid, &status, 0);
+      worker.pid = -1;
+    }
+  }
+  m_childSignals.cancel();
+}
+
+std::string OrderBookGateway::handleApiRequest(
+    std::string_view uri, const http::server::request& req,
+    http::server::reply& rep) {
+  if (uri.ends_with("/workers.api")) {
+    std::lock_guard lock(m_routesMutex);
+    auto workersJson = nlohmann::json::array();
+    for (const auto& worker : m_workers) {
+      workersJson.push_back(
+          {{"id", worker.id},
+           {"pid", worker.pid},
+           {"state", worker.retired    ? "retired"
+                     : worker.pid > 0  ? "running"
+                     : worker.symbols.empty() ? "idle"
+                                               : "down"},
+           {"restarts", worker.restarts},
+           {"symbols", worker.symbols}});
+    }
+    return workersJson.dump();
+  }
+  std::string symbol(getQueryParameter(req.uri, "symbol"));
+  auto workerUri = req.uri;
+  if (symbol.empty()) {
+    if (std::size(m_options.symbols) != 1) {
+      throw std::runtime_error("symbol parameter is missing");
+    }
+    symbol = m_options.symbols.front();
+    workerUri += std::format(
+        "{}symbol={}", req.uri.find('?') == std::string::npos ? "?" : "&",
+        symbol);
+  }
+  std::string socketPath;
+  {
+    std::lock_guard lock(m_routesMutex);
+    auto routeIter = m_routes.find(symbol);
+    if (routeIter == m_routes.end()) {
+      throw std::runtime_error(std::format("symbol {} is not served", symbol));
+    }
+    socketPath = routeIter->second;
+  }
+  auto request = std::format("GET {} HTTP/1.0\r\n", workerUri);
+  if (auto etag = getHeader(req, "If-None-Match"); !etag.empty()) {
+    request += std::format("If-None-Match: {}\r\n", etag);
+  }
+  request += "\r\n";
+  std::string response;
+  try {
+    response = exchange(socketPath, request, m_options.requestTimeout);
+  } catch (const std::exception& ex) {
+    // the worker is restarting or hung, its symbols are unavailable until
+    // it is back
+    LOG_WARN("Worker of " << symbol << " unavailable: " << ex.what());
+    rep.status = http::server::reply::service_unavailable;
+    return {};
+  }
+
+  // "HTTP/1.0 200 OK\r\n" headers "\r\n\r\n" body
+  auto headerEnd = response.find("\r\n\r\n");
+  auto statusStart = response.find(' ');
+  if (headerEnd == std::string::npos || statusStart == std::string::npos ||
+      statusStart > headerEnd) {
+    rep.status = http::server::reply::bad_gateway;
+    return {};
+  }
+  auto status = std::atoi(response.c_str() + statusStart + 1);
+  if (status == http::server::reply::not_found) {
+    throw std::runtime_error(
+        std::format("worker of {} has no {}", symbol, req.uri));
+  }
+  std::string_view headers(response.data(), headerEnd);
+  for (auto name : {"ETag", "Cache-Control"}) {
+    // each header line starts after a CRLF, the status line doesn't count
+    for (auto lineStart = headers.find("\r\n");
+         lineStart != std::string_view::npos;
+         lineStart = headers.find("\r\n", lineStart + 2)) {
+      auto line = headers.substr(lineStart + 2);
+      line = line.substr(0, line.find("\r\n"));
+      auto colon = line.find(':');
+      if (colon != std::string_view::npos &&
+          caseInsensitiveEqual(line.substr(0, colon), name)) {
+        auto value = line.substr(colon + 1);
+        value.remove_prefix(std::min(value.find_first_not_of(' '),
+                                     std::size(value)));
+        rep.headers.push_back({name, std::string(value)});
+      }
+    }
+  }
+  if (status == http::server::reply::not_modified) {
+    rep.status = http::server::reply::not_modified;
+    return {};
+  }
+  if (status != http::server::reply::ok) {
+    rep.status = http::server::reply::bad_gateway;
+    return {};
+  }
+  return response.substr(headerEnd + 4);
+}
+
+void OrderBookGateway::run() {
+  LOG_INFO("Gateway: " << std::size(m_options.symbols) << " symbols on "
+                       << m_options.workerCount << " workers");
+  waitForChildren();
+  m_stopSignals.async_wait([this](boost::system::error_code ec, int signal) {
+    if (ec) {
+      return;
+    }
+    LOG_INFO("Received signal " << signal << ", stopping workers");
+    stop();
+  });
+  for (auto& worker : m_workers) {
+    spawn(worker);
+  }
+  m_ioc.run();
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <sys/types.h>
+
+#include <boost/asio.hpp>
+#include <chrono>
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "ConsistentHashRing.hpp"
+
+namespace http {
+namespace server {
+struct reply;
+struct request;
+}  // namespace server
+}  // namespace http
+
+struct GatewayOptions {
+  // OrderBook executable run by every worker
+  std::string orderBookPath;
+  std::vector<std::string> symbols;
+  std::size_t workerCount{1};
+  // where the workers' http sockets are created
+  std::string socketDirectory;
+  // passed to every worker as is (feed, host, port, ...)
+  std::vector<std::string> workerArguments;
+  std::chrono::milliseconds restartDelay{1000};
+  // a worker exiting more often than this within restartWindow is given up
+  // and its symbols move to the others
+  std::size_t maxRestarts{5};
+  std::chrono::milliseconds restartWindow{60000};
+  // how long a worker may take to answer a forwarded request
+  std::chrono::milliseconds requestTimeout{2000};
+};
+
+// Runs OrderBook worker processes on this host, each one serving the shard
+// of symbols the consistent hash ring assigns to it, and forwards api
+// requests to the worker owning the requested symbol over its Unix domain
+// socket. Workers that exit are restarted; one that keeps failing is
+// retired and the ring moves its symbols to the remaining workers, which
+// are restarted with their grown shard while all others keep running.
+class OrderBookGateway {
+  struct Worker {
+    std::size_t id{0};
+    pid_t pid{-1};
+    std::vector<std::string> symbols;
+    std::string socketPath;
+    bool retired{false};
+    // terminated on purpose to pick up a new shard, not a failure
+    bool respawn{false};
+    std::size_t restarts{0};
+    std::deque<std::chrono::steady_clock::time_point> recentExits;
+    std::unique_ptr<boost::asio::steady_timer> restartTimer;
+  };
+
+  GatewayOptions m_options;
+  boost::asio::io_context m_ioc;
+  boost::asio::signal_set m_childSignals;
+  boost::asio::signal_set m_stopSignals;
+  ConsistentHashRing m_ring;
+  std::vector<Worker> m_workers;
+  bool m_stopping{false};
+  // symbol -> socket of its worker, read by the http server thread
+  std::mutex m_routesMutex;
+  std::unordered_map<std::string, std::string> m_routes;
+
+  void assignSymbols();
+  void spawn(Worker& worker);
+  void terminate(Worker& worker);
+  void waitForChildren();
+  void onWorkerExit(Worker& worker, int status);
+  void retire(Worker& worker);
+  void stop();
+
+ public:
+  explicit OrderBookGateway(GatewayOptions options);
+  ~OrderBookGateway();
+
+  // Answers one api request, see http::server::HttpRequestHandler.
+  std::string handleApiRequest(std::string_view uri,
+                               const http::server::request& req,
+                               http::server::reply& rep);
+  // Supervises the workers until SIGINT/SIGTERM.
+  void run();
+};
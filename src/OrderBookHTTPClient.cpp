@@ -4,6 +4,7 @@
 #include <format>
 #include <iostream>
 #include <nlohmann/json.hpp>
+#include <stdexcept>
 #include <string>
 
 #include "AsyncIOHeaders.h"
@@ -11,27 +12,26 @@
 #include "json_utils.h"
 #include "logging.h"
 
+// One HTTP GET as a single coroutine. Every step runs under the stream's
+// timeout, a failure anywhere surfaces as one exception naming the step.
 class HttpGetter : public std::enable_shared_from_this<HttpGetter> {
   tcp::resolver m_resolver;
   beast::tcp_stream m_stream;
-  DataCallback m_dataCallback;
-  ErrorCallback m_errorCallback;
   beast::flat_buffer m_buffer;
   http::request<http::empty_body> m_httpRequest;
   http::response<http::string_body> m_httpResponse;
 
  public:
-  // Objects are constructed with a strand to
-  // ensure that handlers do not execute concurrently.
-  explicit HttpGetter(asio::io_context& ioc, DataCallback dataCallback,
-                      ErrorCallback errorCallback)
-      : m_resolver{asio::make_strand(ioc)},
-        m_stream{asio::make_strand(ioc)},
-        m_dataCallback{dataCallback},
-        m_errorCallback{errorCallback} {}
-
-  // Start the asynchronous operation
-  void run(std::string_view host, std::string_view port, std::string_view uri) {
+  // The get() coroutine serializes the operations, no strand is needed.
+  explicit HttpGetter(asio::io_context& ioc)
+      : m_resolver{ioc.get_executor()}, m_stream{ioc.get_executor()} {}
+
+  // Returns the response body.
+  asio::awaitable<std::string> get(std::string host, std::string port,
+                                   std::string uri) {
+    // keeps this alive until the response is in, not per operation
+    auto self = shared_from_this();
+
     // Set up an HTTP GET request message
     m_httpRequest.version(DEFAULT_HTTP_CLIENT);
     m_httpRequest.method(http::verb::get);
@@ -39,74 +39,33 @@ class HttpGetter : public std::enable_shared_from_this<HttpGetter> {
     m_httpRequest.set(http::field::host, host);
     m_httpRequest.set(http::field::user_agent, BOOST_BEAST_VERSION_STRING);
 
-    // Look up the domain name
-    m_resolver.async_resolve(
-        host, port,
-        beast::bind_front_handler(&HttpGetter::onResolve, shared_from_this()));
-  }
-
-  void onResolve(beast::error_code ec, tcp::resolver::results_type results) {
-    if (ec) {
-      LOG_ERROR("resolve failed: " << ec.message());
-      return;
+    const char* step = "resolve";
+    try {
+      auto results =
+          co_await m_resolver.async_resolve(host, port, asio::use_awaitable);
+
+      step = "connect";
+      m_stream.expires_after(std::chrono::seconds(30));
+      co_await m_stream.async_connect(results, asio::use_awaitable);
+
+      step = "sending HttpRequest";
+      m_stream.expires_after(std::chrono::seconds(30));
+      co_await http::async_write(m_stream, m_httpRequest, asio::use_awaitable);
+
+      step = "getting HttpResponse";
+      co_await http::async_read(m_stream, m_buffer, m_httpResponse,
+                                asio::use_awaitable);
+    } catch (const boost::system::system_error& ex) {
+      throw std::runtime_error(
+          std::format("{} failed: {}", step, ex.code().message()));
     }
-
-    // Set a timeout on the operation
-    m_stream.expires_after(std::chrono::seconds(30));
-
-    // Make the connection on the IP address we get from a lookup
-    m_stream.async_connect(
-        results,
-        beast::bind_front_handler(&HttpGetter::onConnect, shared_from_this()));
-  }
-
-  void onConnect(beast::error_code ec,
-                 tcp::resolver::results_type::endpoint_type) {
-    if (ec) {
-      LOG_ERROR("connect failed: " << ec.message());
-      return;
-    }
-
-    // Set a timeout on the operation
-    m_stream.expires_after(std::chrono::seconds(30));
-
-    // Send the HTTP request to the remote host
-    http::async_write(
-        m_stream, m_httpRequest,
-        beast::bind_front_handler(&HttpGetter::onWrite, shared_from_this()));
-  }
-
-  void onWrite(beast::error_code ec, std::size_t bytesTransferred) {
-    boost::ignore_unused(bytesTransferred);
-    if (ec) {
-      LOG_ERROR("sending HttpRequest failed: " << ec.message());
-      return;
-    }
-
-    // Receive the HTTP response
-    http::async_read(
-        m_stream, m_buffer, m_httpResponse,
-        beast::bind_front_handler(&HttpGetter::onRead, shared_from_this()));
-  }
-
-  void onRead(beast::error_code ec, std::size_t bytesTransferred) {
-    boost::ignore_unused(bytesTransferred);
-
-    if (ec) {
-      LOG_ERROR("getting HttpResponse failed: " << ec.message());
-      return;
-    }
-
-    LOG_INFO("data received over http: " << m_httpResponse.body());
-
-    m_dataCallback({static_cast<const char*>(m_httpResponse.body().data()),
-                    m_httpResponse.body().size()});
-
     stop();
+    co_return std::move(m_httpResponse.body());
   }
 
   void stop() {
     beast::error_code ec;
+    m_resolver.cancel();
     // Gracefully close the socket
     m_stream.socket().shutdown(tcp::socket::shutdown_both, ec);
 
@@ -114,62 +73,41 @@ class HttpGetter : public std::enable_shared_from_this<HttpGetter> {
     if (ec && ec != beast::errc::not_connected) {
       LOG_ERROR("shutdown Http connection failed: " << ec.message());
     }
+    // a connect or read in flight completes with operation_aborted
+    m_stream.socket().close(ec);
   }
 };
 
-OrderBookHTTPClient::OrderBookHTTPClient(
-    OrderBookSnapshotCallback orderBookSnapshotCallback,
-    ErrorCallback errorCallback, boost::asio::io_context& ioc,
-    std::string_view host, std::string_view port, std::string_view uri)
-    : m_orderBookSnapshotCallback{orderBookSnapshotCallback},
-      m_errorCallback{errorCallback},
-      m_host{host},
+OrderBookHTTPClient::OrderBookHTTPClient(const FeedAdapterVariant& feedAdapter,
+                                         std::string_view symbol,
+                                         boost::asio::io_context& ioc,
+                                         std::string_view host,
+                                         std::string_view port)
+    : m_host{host},
       m_port{port},
-      m_uri{uri},
-      m_httpGetter{std::make_shared<HttpGetter>(
-          ioc,
-          [&](std::string_view jsonData) {
-            try {
-              try {
-                LOG_INFO("Snapshot received: " << jsonData.data());
-                OrderBookSnapshot orderBookSnapshot;
-                jsonToOrderBookSnapshot(jsonData, orderBookSnapshot);
-                m_orderBookSnapshotCallback(std::move(orderBookSnapshot));
-              } catch (const std::exception& ex) {
-                LOG_ERROR(
-                    "Failed to process message received from http, exception: "
-                    << ex.what());
-                LOG_INFO("message received from websocket:" << jsonData);
-                m_errorCallback();
-              } catch (...) {
-                LOG_ERROR(
-                    "Unknown exception, Failed to process message received "
-                    "from http");
-                LOG_INFO("message received from websocket: : " << jsonData);
-                m_errorCallback();
-              }
-            } catch (...) {
-              m_errorCallback();
-            }
+      m_uri{std::visit(
+          [&](auto adapter) {
+            return decltype(adapter)::snapshotUri(symbol);
           },
-          m_errorCallback)} {}
+          feedAdapter)},
+      m_parseSnapshot{std::visit(
+          [](auto adapter) -> ParseSnapshot {
+            return &decltype(adapter)::parseSnapshot;
+          },
+          feedAdapter)},
+      m_httpGetter{std::make_shared<HttpGetter>(ioc)} {}
+
+asio::awaitable<OrderBookSnapshot> OrderBookHTTPClient::fetch() {
+  // this may be destroyed while the request is in flight
+  auto httpGetter = m_httpGetter;
+  auto parseSnapshot = m_parseSnapshot;
+  auto jsonData = co_await httpGetter->get(m_host, m_port, m_uri);
+  LOG_INFO("Snapshot received: " << jsonData);
+  OrderBookSnapshot orderBookSnapshot;
+  parseSnapshot(jsonData, orderBookSnapshot);
+  co_return orderBookSnapshot;
+}
 
 OrderBookHTTPClient::~OrderBookHTTPClient() = default;
 
-void OrderBookHTTPClient::run() { m_httpGetter->run(m_host, m_port, m_uri); };
-
 void OrderBookHTTPClient::stop() { m_httpGetter->stop(); }
-
-void OrderBookHTTPClient::jsonToOrderBookSnapshot(
-    std::string_view json, OrderBookSnapshot& orderBookSnapshot) {
-  nlohmann::json jsonSnapshot = nlohmann::json::parse(json)["data"];
-  orderBookSnapshot.timestamp = TimePoint(jsonSnapshot["time"].get<long>());
-  orderBookSnapshot.sequence =
-      std::stoull(jsonSnapshot["sequence"].get<std::string>());
-  const auto& jsonBids =
-      jsonSnapshot["bids"].template get<std::vector<nlohmann::json>>();
-  JsonUtils::populatePriceLevels(orderBookSnapshot.bids, jsonBids);
-  const auto& jsonAsks =
-      jsonSnapshot["asks"].template get<std::vector<nlohmann::json>>();
-  JsonUtils::populatePriceLevels(orderBookSnapshot.asks, jsonAsks);
-}
\ No newline at end of file
@@ -1,40 +1,36 @@
 #pragma once
 
-#include <functional>
+#include <boost/asio/awaitable.hpp>
 #include <memory>
 #include <string>
 
+#include "FeedAdapters.hpp"
+
 namespace boost {
 namespace asio {
 class io_context;
 }
 }  // namespace boost
 
-class OrderBookSnapshot;
-class IncrementalUpdate;
 class HttpGetter;
 
-using OrderBookSnapshotCallback = std::function<void(OrderBookSnapshot&&)>;
-using ErrorCallback = std::function<void()>;
-
 class OrderBookHTTPClient {
-  OrderBookSnapshotCallback m_orderBookSnapshotCallback;
-  ErrorCallback m_errorCallback;
+  using ParseSnapshot = void (*)(std::string_view, OrderBookSnapshot&);
+
   std::string m_host;
   std::string m_port;
   std::string m_uri;
-  int m_httpVersion;
+  ParseSnapshot m_parseSnapshot;
   std::shared_ptr<HttpGetter> m_httpGetter;
 
-  void jsonToOrderBookSnapshot(std::string_view json,
-                               OrderBookSnapshot& orderBookSnapshot);
-
  public:
-  OrderBookHTTPClient(OrderBookSnapshotCallback orderBookSnapshotCallback,
-                      ErrorCallback errorCallback, boost::asio::io_context& ioc,
-                      std::string_view host, std::string_view port,
-                      std::string_view uri);
+  // Requests the snapshot of `symbol` from the adapter's snapshot uri.
+  OrderBookHTTPClient(const FeedAdapterVariant& feedAdapter,
+                      std::string_view symbol, boost::asio::io_context& ioc,
+                      std::string_view host, std::string_view port);
   ~OrderBookHTTPClient();
-  void run();
+  // Throws when the request fails, times out or the snapshot can't be
+  // parsed.
+  boost::asio::awaitable<OrderBookSnapshot> fetch();
   void stop();
 };
\ No newline at end of file
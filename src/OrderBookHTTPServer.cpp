@@ -1,7 +1,45 @@
-
 #include "OrderBookHTTPServer.h"
 
+#include <algorithm>
 #include <boost_http_server/server.hpp>
+#include <format>
+#include <optional>
+#include <stdexcept>
+#include <string>
+
+#include "utils.h"
+
+namespace {
+
+std::string_view getHeader(const http::server::request& req,
+                           std::string_view name) {
+  for (const auto& header : req.headers) {
+    if (caseInsensitiveEqual(header.name, name)) {
+      return header.value;
+    }
+  }
+  return {};
+}
+
+// ETag is the book sequence, accepts "123", W/"123" or a bare 123
+std::optional<SequenceType> parseETag(std::string_view etag) {
+  if (etag.starts_with("W/")) {
+    etag.remove_prefix(2);
+  }
+  if (std::size(etag) >= 2 && etag.front() == '"' && etag.back() == '"') {
+    etag = etag.substr(1, std::size(etag) - 2);
+  }
+  if (etag.empty()) {
+    return std::nullopt;
+  }
+  try {
+    return std::stoull(std::string(etag));
+  } catch (...) {
+    return std::nullopt;
+  }
+}
+
+}  // namespace
 
 OrderBookHTTPServer::OrderBookHTTPServer(GetSnapshotHandler getSnapshotHandler,
                                          std::string_view host,
@@ -11,8 +49,67 @@ OrderBookHTTPServer::OrderBookHTTPServer(GetSnapshotHandler getSnapshotHandler,
       m_httpServer{std::make_unique<http::server::server>(
           std::string(host), std::string(port), std::string(documentDir),
           [&](std::string_view uri, const http::server::request& req,
-              http::server::reply& rep) { return m_getSnapshotHandler(); })} {}
+              http::server::reply& rep) {
+            return handleApiRequest(uri, req, rep);
+          })} {}
+
+std::string OrderBookHTTPServer::handleApiRequest(
+    std::string_view uri, const http::server::request& req,
+    http::server::reply& rep) {
+  // path may carry a prefix added by a reverse proxy, dispatch on the last
+  // path component only
+  auto apiName = uri.substr(uri.find_last_of('/') + 1);
+
+  SnapshotQuery snapshotQuery;
+  snapshotQuery.symbol = getQueryParameter(req.uri, "symbol");
+  if (auto depth = getQueryParameter(req.uri, "depth"); !depth.empty()) {
+    snapshotQuery.depth = std::stoull(std::string(depth));
+  }
+  if (apiName == "buckets.api") {
+    auto bucket = getQueryParameter(req.uri, "bucket");
+    if (bucket.empty()) {
+      throw std::runtime_error("bucket parameter is missing");
+    }
+    snapshotQuery.bucketSize = std::stod(std::string(bucket));
+    if (snapshotQuery.bucketSize <= 0) {
+      throw std::runtime_error(
+          std::format("invalid bucket parameter {}", bucket));
+    }
+  } else if (apiName == "history.api") {
+    if (auto sequence = getQueryParameter(req.uri, "sequence");
+        !sequence.empty()) {
+      snapshotQuery.atSequence = std::stoull(std::string(sequence));
+    } else if (auto time = getQueryParameter(req.uri, "time"); !time.empty()) {
+      snapshotQuery.atTimestamp = TimePoint(std::stoll(std::string(time)));
+    } else {
+      throw std::runtime_error("sequence or time parameter is missing");
+    }
+  } else if (apiName == "orders.api") {
+    snapshotQuery.orderCounts = true;
+  } else if (apiName == "queue.api") {
+    auto order = getQueryParameter(req.uri, "order");
+    if (order.empty()) {
+      throw std::runtime_error("order parameter is missing");
+    }
+    snapshotQuery.queueOrderId = std::stoull(std::string(order));
+  } else if (apiName == "bbo.api") {
+    snapshotQuery.topOfBook = true;
+  } else if (apiName != "snapshot.api") {
+    throw std::runtime_error(std::format("unknown api {}", uri));
+  }
+  snapshotQuery.ifNoneMatch = parseETag(getHeader(req, "If-None-Match"));
+
+  auto snapshotResponse = m_getSnapshotHandler(snapshotQuery);
+  rep.headers.push_back(
+      {"ETag", std::format("\"{}\"", snapshotResponse.sequence)});
+  rep.headers.push_back({"Cache-Control", "no-cache"});
+  if (snapshotResponse.notModified) {
+    rep.status = http::server::reply::not_modified;
+    return {};
+  }
+  return std::move(snapshotResponse.json);
+}
 
 void OrderBookHTTPServer::run() { m_httpServer->run(); }
 
-OrderBookHTTPServer::~OrderBookHTTPServer() = default;
\ No newline at end of file
+OrderBookHTTPServer::~OrderBookHTTPServer() = default;
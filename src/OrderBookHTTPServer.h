@@ -4,16 +4,25 @@
 #include <memory>
 #include <string>
 
-using GetSnapshotHandler = std::function<std::string()>;
+#include "common_header.h"
+
+using GetSnapshotHandler =
+    std::function<SnapshotResponse(const SnapshotQuery& snapshotQuery)>;
 
 namespace http::server {
 class server;
-}
+struct request;
+struct reply;
+}  // namespace http::server
 
 class OrderBookHTTPServer {
   GetSnapshotHandler m_getSnapshotHandler;
   std::unique_ptr<http::server::server> m_httpServer;
 
+  std::string handleApiRequest(std::string_view uri,
+                               const http::server::request& req,
+                               http::server::reply& rep);
+
  public:
   OrderBookHTTPServer(GetSnapshotHandler getSnapshotHandler,
                       std::string_view host, std::string_view port,
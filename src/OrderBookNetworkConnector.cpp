@@ -1,29 +1,66 @@
 #include "OrderBookNetworkConnector.h"
 
 #include <chrono>
+#include <exception>
 #include <format>
-#include <thread>
 
 #include "AsyncIOHeaders.h"
+#include "BookHistory.h"
+#include "BookImage.h"
 #include "OrderBook.hpp"
 #include "OrderBookHTTPClient.h"
 #include "OrderBookWsClient.h"
 #include "json_utils.h"
 #include "logging.h"
+#include "utils.h"
 
-OrderBookNetworkConnector::OrderBookNetworkConnector(std::string_view host,
-                                                     std::string_view port,
-                                                     int reconnectDelay,
-                                                     bool useLock)
+namespace {
+
+// Completion of the detached coroutines, errors they don't handle end run()
+// like an exception from any other handler would.
+void rethrowException(std::exception_ptr exception) {
+  if (exception) {
+    std::rethrow_exception(exception);
+  }
+}
+
+}  // namespace
+
+OrderBookNetworkConnector::OrderBookNetworkConnector(
+    std::string_view host, std::string_view port, int reconnectDelay,
+    bool useLock, std::vector<PriceType> bucketSizes,
+    UpdateBatchingOptions updateBatchingOptions,
+    FeedThreadOptions feedThreadOptions, FeedAdapterVariant feedAdapter,
+    std::string_view symbol, FeedCompressionOptions feedCompressionOptions,
+    std::size_t checksumDepth)
     : m_ioc{std::make_unique<asio::io_context>()},
       m_host{host},
       m_port{port},
+      m_feedAdapter{feedAdapter},
+      m_symbol{!symbol.empty() ? std::string(symbol)
+                               : std::visit(
+                                     [](auto adapter) {
+                                       return std::string(
+                                           decltype(adapter)::DEFAULT_SYMBOL);
+                                     },
+                                     feedAdapter)},
       m_reconnectDelay{reconnectDelay},
+      m_bucketSizes{std::move(bucketSizes)},
+      m_updateBatchingOptions{updateBatchingOptions},
+      m_feedThreadOptions{feedThreadOptions},
+      m_feedCompressionOptions{feedCompressionOptions},
+      m_checksumDepth{checksumDepth},
       m_spinLock{!useLock},
       m_snapshotReceived{false},
       m_signaledToStop{false},
       m_disconnecting{false},
-      m_signals(*m_ioc) {}
+      m_signals(*m_ioc),
+      m_bookImageTimer(*m_ioc) {
+  LOG_INFO("Feed: "
+           << std::visit([](auto adapter) { return decltype(adapter)::NAME; },
+                         m_feedAdapter)
+           << " " << m_symbol);
+}
 
 void OrderBookNetworkConnector::setupSignalHandler() {
   m_signals.add(SIGINT);
@@ -35,28 +72,49 @@ void OrderBookNetworkConnector::setupSignalHandler() {
   m_signals.async_wait([this](boost::system::error_code ec, int signal) {
     LOG_INFO(std::format("Received signal: {}, ec: {}", signal, ec.message()));
     m_signaledToStop = true;
+    // a restart picks up from here instead of waiting for a snapshot
+    saveBookImage();
+    m_bookImageTimer.cancel();
     disconnect();
   });
 }
 void OrderBookNetworkConnector::reset() {
   LOG_INFO("Resetting..");
   SpinLockGaurd spinLockGaurd(m_spinLock);
-  setupSignalHandler();
+  ++m_connection;
   m_snapshotReceived = false;
   m_disconnecting = false;
   m_orderBookWsClient.reset();
   m_orderBookHTTPClient.reset();
-  m_orderBook = std::make_unique<OrderBook>();
+  m_orderBook = std::make_unique<OrderBook>(
+      m_bucketSizes, m_checksumDepth,
+      std::visit(
+          [](auto adapter) { return decltype(adapter)::MARKET_BY_ORDER; },
+          m_feedAdapter));
+  for (const auto& topOfBookCallback : m_topOfBookCallbacks) {
+    m_orderBook->addTopOfBookCallback(topOfBookCallback);
+  }
+  if (m_restoredImage) {
+    LOG_INFO("Restoring book image at sequence " << m_restoredImage->sequence);
+    m_orderBook->restoreImage(std::move(*m_restoredImage));
+    m_restoredImage.reset();
+  }
   //   m_isSnapshotReceived = false;
   auto incrementalUpdateCallback = [&](IncrementalUpdate&& incrementalUpdate) {
     LOG_TRACE("incrementalUpdateCallback");
     onIncrementalUpdate(std::move(incrementalUpdate));
   };
+  auto incrementalUpdateBatchCallback =
+      [&](std::vector<IncrementalUpdate>& incrementalUpdates) {
+        LOG_TRACE("incrementalUpdateBatchCallback");
+        onIncrementalUpdates(incrementalUpdates);
+      };
 
-  auto disconnectCallback = [this]() { disconnect(); };
   m_orderBookWsClient = std::make_unique<OrderBookWsClient>(
-      incrementalUpdateCallback, disconnectCallback, *m_ioc, m_host, m_port,
-      "/ws");
+      m_feedAdapter, m_symbol, incrementalUpdateCallback,
+      incrementalUpdateBatchCallback, *m_ioc, m_host, m_port,
+      m_updateBatchingOptions, m_feedThreadOptions.socketBusyPollMicros,
+      m_feedCompressionOptions);
   // DO NOT create or run m_orderBookHTTPClient yet, run once we received first
   // response on websocket
 }
@@ -75,20 +133,44 @@ void OrderBookNetworkConnector::disconnect() {
   }
 }
 
-void OrderBookNetworkConnector::run() {
-  LOG_INFO("Running OrderBookNetworkConnector");
-  reset();
+asio::awaitable<void> OrderBookNetworkConnector::maintainConnection() {
+  asio::steady_timer reconnectTimer(co_await asio::this_coro::executor);
   while (true) {
-    m_orderBookWsClient->run();
-    m_ioc->run();
+    reset();
+    co_await m_orderBookWsClient->run();
+    // whatever ended the session, a snapshot request still in flight
+    // belongs to the lost connection
+    disconnect();
     if (m_signaledToStop) {
       break;
     }
     LOG_INFO("Sleeping before reconnecting..." << m_host << ":" << m_port);
-    std::this_thread::sleep_for(std::chrono::milliseconds(m_reconnectDelay));
+    reconnectTimer.expires_after(std::chrono::milliseconds(m_reconnectDelay));
+    co_await reconnectTimer.async_wait(asio::use_awaitable);
+    if (m_signaledToStop) {
+      break;
+    }
     LOG_INFO("Reconnecting...");
-    m_ioc->restart();
-    reset();
+  }
+}
+
+void OrderBookNetworkConnector::run() {
+  LOG_INFO("Running OrderBookNetworkConnector");
+  if (m_feedThreadOptions.cpu >= 0) {
+    pinCurrentThread(m_feedThreadOptions.cpu);
+  }
+  setupSignalHandler();
+  asio::co_spawn(*m_ioc, maintainConnection(), rethrowException);
+  if (m_bookImage) {
+    asio::co_spawn(*m_ioc, saveBookImagePeriodically(), rethrowException);
+  }
+  if (m_feedThreadOptions.busyPoll) {
+    // never sleeps in epoll, a frame is picked up as soon as it lands
+    while (!m_ioc->stopped()) {
+      m_ioc->poll();
+    }
+  } else {
+    m_ioc->run();
   }
 }
 
@@ -100,18 +182,78 @@ void OrderBookNetworkConnector::onIncrementalUpdate(
   LOG_TRACE("onIncrementalUpdate");
   {
     SpinLockGaurd spinLockGaurd(m_spinLock);
-    m_orderBook->applyIncrementalUpdate(std::move(incrementalUpdate));
+    applyIncrementalUpdate(std::move(incrementalUpdate));
+  }
+  if (resyncIfDiverged()) {
+    return;
+  }
+  requestSnapshotIfNeeded();
+}
+
+void OrderBookNetworkConnector::onIncrementalUpdates(
+    std::vector<IncrementalUpdate>& incrementalUpdates) {
+  if (m_disconnecting) {
+    return;
+  }
+  LOG_TRACE("onIncrementalUpdates " << std::size(incrementalUpdates));
+  {
+    // whole batch is published to snapshot readers at once
+    SpinLockGaurd spinLockGaurd(m_spinLock);
+    for (auto& incrementalUpdate : incrementalUpdates) {
+      applyIncrementalUpdate(std::move(incrementalUpdate));
+    }
+  }
+  if (resyncIfDiverged()) {
+    return;
   }
+  requestSnapshotIfNeeded();
+}
+
+void OrderBookNetworkConnector::applyIncrementalUpdate(
+    IncrementalUpdate&& incrementalUpdate) {
+  // caller holds m_spinLock
+  bool synchronized = m_orderBook->isSnapshotReceived();
+  // A synchronized book applies the update in place rather than moving it
+  // to its pending queue, so it is recorded afterwards, with the levels a
+  // market by order book derived from the orders.
+  if (m_orderBook->applyIncrementalUpdate(std::move(incrementalUpdate)) &&
+      synchronized && m_bookHistoryWriter) {
+    m_bookHistoryWriter->stageIncrementalUpdate(incrementalUpdate);
+    m_bookHistoryWriter->commitIncrementalUpdate(*m_orderBook);
+  }
+  if (!synchronized && m_orderBook->isSnapshotReceived()) {
+    // the feed continued a restored book image, it stands in for the
+    // snapshot
+    m_snapshotReceived = true;
+    if (m_bookHistoryWriter) {
+      m_bookHistoryWriter->writeCheckpoint(*m_orderBook);
+    }
+  }
+}
+
+void OrderBookNetworkConnector::requestSnapshotIfNeeded() {
   if (!m_snapshotReceived && !m_orderBookHTTPClient) {
     LOG_INFO("Creating OrderBookHTTPClient ..");
-    auto snapshotCallback = [this](OrderBookSnapshot&& orderBookSnapshot) {
-      onSnapshot(std::move(orderBookSnapshot));
-    };
-    auto disconnectCallback = [this]() { reset(); };
     m_orderBookHTTPClient = std::make_unique<OrderBookHTTPClient>(
-        snapshotCallback, disconnectCallback, *m_ioc, m_host, m_port,
-        "/snapshot");
-    m_orderBookHTTPClient->run();
+        m_feedAdapter, m_symbol, *m_ioc, m_host, m_port);
+    asio::co_spawn(*m_ioc, requestSnapshot(), rethrowException);
+  }
+}
+
+asio::awaitable<void> OrderBookNetworkConnector::requestSnapshot() {
+  auto connection = m_connection;
+  try {
+    auto orderBookSnapshot = co_await m_orderBookHTTPClient->fetch();
+    if (connection == m_connection) {
+      onSnapshot(std::move(orderBookSnapshot));
+    }
+  } catch (const std::exception& ex) {
+    if (connection != m_connection || m_disconnecting) {
+      // stopped on purpose, nothing to recover from
+      co_return;
+    }
+    LOG_ERROR("Snapshot request failed: " << ex.what());
+    disconnect();
   }
 }
 
@@ -123,21 +265,211 @@ void OrderBookNetworkConnector::onSnapshot(
   LOG_INFO("Received snapshot");
   SpinLockGaurd spinLockGaurd(m_spinLock);
   m_orderBook->applySnapshot(std::move(orderBookSnapshot));
+  if (m_bookHistoryWriter) {
+    // replay must never cross a resync, start it from a fresh checkpoint
+    m_bookHistoryWriter->writeCheckpoint(*m_orderBook);
+  }
   m_orderBookHTTPClient.reset();
   m_snapshotReceived = true;
+  resyncIfDiverged();
+}
+
+bool OrderBookNetworkConnector::resyncIfDiverged() {
+  // after a gap every later update would be rejected as well, after a
+  // checksum mismatch every later one would be applied to a wrong book,
+  // either way start over from a new snapshot through the reconnect path
+  if (m_orderBook->hasSequenceGap()) {
+    LOG_WARN("Sequence gap detected, resynchronizing");
+  } else if (m_orderBook->hasChecksumMismatch()) {
+    LOG_WARN("Checksum mismatch detected, resynchronizing");
+  } else {
+    return false;
+  }
+  disconnect();
+  return true;
+}
+
+void OrderBookNetworkConnector::enableBookImage(
+    const std::string& path, std::chrono::milliseconds interval) {
+  m_bookImage = std::make_unique<BookImage>(path);
+  m_bookImageInterval = interval;
+  m_restoredImage = m_bookImage->load();
+  if (m_restoredImage) {
+    m_savedImageSequence = m_restoredImage->sequence;
+  }
+}
+
+void OrderBookNetworkConnector::addTopOfBookCallback(
+    TopOfBookCallback topOfBookCallback) {
+  m_topOfBookCallbacks.push_back(std::move(topOfBookCallback));
+}
+
+asio::awaitable<void> OrderBookNetworkConnector::saveBookImagePeriodically() {
+  while (!m_signaledToStop) {
+    m_bookImageTimer.expires_after(m_bookImageInterval);
+    boost::system::error_code ec;
+    co_await m_bookImageTimer.async_wait(
+        asio::redirect_error(asio::use_awaitable, ec));
+    if (!ec) {
+      saveBookImage();
+    }
+  }
+}
+
+void OrderBookNetworkConnector::saveBookImage() {
+  // runs on the feed thread, the book can't change meanwhile
+  if (!m_bookImage || !m_orderBook || !m_orderBook->isSnapshotReceived() ||
+      m_orderBook->hasSequenceGap() || m_orderBook->hasChecksumMismatch() ||
+      m_orderBook->getSequence() == m_savedImageSequence) {
+    return;
+  }
+  m_bookImage->save(*m_orderBook);
+  m_savedImageSequence = m_orderBook->getSequence();
+  LOG_DEBUG("Saved book image at sequence " << m_savedImageSequence);
+}
+
+void OrderBookNetworkConnector::enableHistory(
+    std::string_view directory, std::chrono::milliseconds checkpointInterval) {
+  m_historyDirectory = directory;
+  m_bookHistoryWriter = std::make_unique<BookHistoryWriter>(
+      m_historyDirectory, checkpointInterval);
+}
+
+SnapshotResponse OrderBookNetworkConnector::getHistoricalSnapshot(
+    const SnapshotQuery& snapshotQuery) {
+  if (m_historyDirectory.empty()) {
+    throw std::runtime_error("book history is not recorded.");
+  }
+  // history files are append only, reading them needs no lock
+  BookHistoryReader bookHistoryReader(m_historyDirectory);
+  auto orderBook =
+      snapshotQuery.atSequence
+          ? bookHistoryReader.rebuildAtSequence(*snapshotQuery.atSequence)
+          : bookHistoryReader.rebuildAtTimestamp(*snapshotQuery.atTimestamp);
+  OrderBookSnapshot orderBookSnapshot{
+      .sequence = orderBook.getSequence(),
+      .timestamp = orderBook.getLastUpdateTimestamp()};
+  if (snapshotQuery.ifNoneMatch &&
+      *snapshotQuery.ifNoneMatch == orderBookSnapshot.sequence) {
+    return {.sequence = orderBookSnapshot.sequence, .notModified = true};
+  }
+  orderBook.getLevels(snapshotQuery.depth, orderBookSnapshot.bids,
+                      orderBookSnapshot.asks);
+  if (m_checksumDepth > 0) {
+    orderBookSnapshot.checksum = book_checksum::compute(
+        orderBook.getBids(), orderBook.getAsks(), m_checksumDepth);
+  }
+  return {.sequence = orderBookSnapshot.sequence,
+          .json = JsonUtils::orderBookSnapshotToJson(orderBookSnapshot)};
 }
 
-std::string OrderBookNetworkConnector::getSnapshot() {
-  OrderBook orderBook;
+SnapshotResponse OrderBookNetworkConnector::getOrderSnapshot(
+    const SnapshotQuery& snapshotQuery) {
+  OrderCountSnapshot orderCountSnapshot;
+  std::optional<QueuePosition> queuePosition;
+  {
+    SpinLockGaurd spinLockGaurd(m_spinLock);
+    if (!m_orderBook || m_disconnecting) {
+      throw std::runtime_error("orderBook is being reset.");
+    }
+    orderCountSnapshot.sequence = m_orderBook->getSequence();
+    if (snapshotQuery.ifNoneMatch &&
+        *snapshotQuery.ifNoneMatch == orderCountSnapshot.sequence) {
+      return {.sequence = orderCountSnapshot.sequence, .notModified = true};
+    }
+    if (snapshotQuery.queueOrderId) {
+      queuePosition =
+          m_orderBook->getQueuePosition(*snapshotQuery.queueOrderId);
+    } else {
+      orderCountSnapshot.timestamp = m_orderBook->getLastUpdateTimestamp();
+      m_orderBook->getOrderCountLevels(snapshotQuery.depth,
+                                       orderCountSnapshot.bids,
+                                       orderCountSnapshot.asks);
+    }
+  }
+  if (!snapshotQuery.queueOrderId) {
+    return {.sequence = orderCountSnapshot.sequence,
+            .json = JsonUtils::orderCountSnapshotToJson(orderCountSnapshot)};
+  }
+  if (!queuePosition) {
+    throw std::runtime_error(std::format("order {} is not in the book",
+                                         *snapshotQuery.queueOrderId));
+  }
+  return {.sequence = queuePosition->sequence,
+          .json = JsonUtils::queuePositionToJson(*queuePosition)};
+}
+
+SnapshotResponse OrderBookNetworkConnector::getTopOfBook(
+    const SnapshotQuery& snapshotQuery) {
+  TopOfBook topOfBook;
+  {
+    SpinLockGaurd spinLockGaurd(m_spinLock);
+    if (!m_orderBook || m_disconnecting) {
+      throw std::runtime_error("orderBook is being reset.");
+    }
+    topOfBook = m_orderBook->getTopOfBook();
+  }
+  // tagged with the sequence that last changed the top, pollers get 304
+  // for as long as it stays put
+  if (snapshotQuery.ifNoneMatch &&
+      *snapshotQuery.ifNoneMatch == topOfBook.sequence) {
+    return {.sequence = topOfBook.sequence, .notModified = true};
+  }
+  return {.sequence = topOfBook.sequence,
+          .json = JsonUtils::topOfBookToJson(topOfBook)};
+}
+
+SnapshotResponse OrderBookNetworkConnector::getSnapshot(
+    const SnapshotQuery& snapshotQuery) {
+  if (snapshotQuery.atSequence || snapshotQuery.atTimestamp) {
+    return getHistoricalSnapshot(snapshotQuery);
+  }
+  if (snapshotQuery.topOfBook) {
+    return getTopOfBook(snapshotQuery);
+  }
+  if (snapshotQuery.orderCounts || snapshotQuery.queueOrderId) {
+    return getOrderSnapshot(snapshotQuery);
+  }
+  // Only the requested depth is copied under the lock, serialization happens
+  // after releasing it.
+  OrderBookSnapshot orderBookSnapshot{};
+  BucketedSnapshot bucketedSnapshot{.bucketSize = snapshotQuery.bucketSize};
+  SequenceType sequence{0};
+  TimePoint timestamp{0};
+  std::optional<std::uint32_t> checksum;
   if (!m_disconnecting) {
     SpinLockGaurd spinLockGaurd(m_spinLock);
     if (!m_orderBook) {
       throw std::runtime_error("orderBook is being reset.");
     }
-    // copy order book atomically
-    orderBook = *m_orderBook;
+    sequence = m_orderBook->getSequence();
+    if (snapshotQuery.ifNoneMatch && *snapshotQuery.ifNoneMatch == sequence) {
+      return {.sequence = sequence, .notModified = true};
+    }
+    timestamp = m_orderBook->getLastUpdateTimestamp();
+    if (m_checksumDepth > 0 && m_orderBook->isSnapshotReceived()) {
+      checksum = m_orderBook->getChecksum();
+    }
+    if (snapshotQuery.bucketSize > 0) {
+      m_orderBook->getBucketLevels(snapshotQuery.bucketSize,
+                                   snapshotQuery.depth, bucketedSnapshot.bids,
+                                   bucketedSnapshot.asks);
+    } else {
+      m_orderBook->getLevels(snapshotQuery.depth, orderBookSnapshot.bids,
+                             orderBookSnapshot.asks);
+    }
+  }
+  if (snapshotQuery.bucketSize > 0) {
+    bucketedSnapshot.sequence = sequence;
+    bucketedSnapshot.timestamp = timestamp;
+    return {.sequence = sequence,
+            .json = JsonUtils::bucketedSnapshotToJson(bucketedSnapshot)};
   }
-  return JsonUtils::orderBookSnapshotToJson(orderBook);
+  orderBookSnapshot.sequence = sequence;
+  orderBookSnapshot.timestamp = timestamp;
+  orderBookSnapshot.checksum = checksum;
+  return {.sequence = sequence,
+          .json = JsonUtils::orderBookSnapshotToJson(orderBookSnapshot)};
 }
 
 OrderBookNetworkConnector::~OrderBookNetworkConnector() = default;
\ No newline at end of file
@@ -1,10 +1,18 @@
 #pragma once
 
 #include <boost/asio.hpp>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
 #include <functional>
 #include <memory>
+#include <optional>
 #include <string>
+#include <vector>
 
+#include "BookChecksum.hpp"
+#include "FeedAdapters.hpp"
+#include "common_header.h"
 #include "spin_lock.hpp"
 
 namespace boost {
@@ -13,8 +21,8 @@ class io_context;
 }
 }  // namespace boost
 
-class OrderBookSnapshot;
-class IncrementalUpdate;
+class BookHistoryWriter;
+class BookImage;
 class OrderBookWsClient;
 class OrderBookHTTPClient;
 class OrderBook;
@@ -24,12 +32,31 @@ class OrderBookNetworkConnector {
   std::unique_ptr<boost::asio::io_context> m_ioc;
   std::string m_host;
   std::string m_port;
+  FeedAdapterVariant m_feedAdapter;
+  std::string m_symbol;
   int m_reconnectDelay;
+  std::vector<PriceType> m_bucketSizes;
+  UpdateBatchingOptions m_updateBatchingOptions;
+  FeedThreadOptions m_feedThreadOptions;
+  FeedCompressionOptions m_feedCompressionOptions;
+  std::size_t m_checksumDepth;
+  std::string m_historyDirectory;
+  std::unique_ptr<BookHistoryWriter> m_bookHistoryWriter;
+  std::unique_ptr<BookImage> m_bookImage;
+  std::chrono::milliseconds m_bookImageInterval{0};
+  // image loaded at startup, handed to the book of the first connection
+  std::optional<OrderBookSnapshot> m_restoredImage;
+  SequenceType m_savedImageSequence{0};
+  // handed to the book of every connection
+  std::vector<TopOfBookCallback> m_topOfBookCallbacks;
   SpinLock m_spinLock;
   bool m_snapshotReceived;
+  // bumped on every reset, tells requests of a lost connection apart
+  std::uint64_t m_connection{0};
   bool m_disconnecting;
   bool m_signaledToStop;
   boost::asio::signal_set m_signals;
+  boost::asio::steady_timer m_bookImageTimer;
   OrderBookRef m_orderBook;
   std::unique_ptr<OrderBookWsClient> m_orderBookWsClient;
   std::unique_ptr<OrderBookHTTPClient> m_orderBookHTTPClient;
@@ -37,13 +64,49 @@ class OrderBookNetworkConnector {
   void setupSignalHandler();
   void reset();
   void disconnect();
+  // Reconnects after every lost connection until signaled to stop.
+  boost::asio::awaitable<void> maintainConnection();
+  boost::asio::awaitable<void> requestSnapshot();
+  // Saves the book every m_bookImageInterval until signaled to stop.
+  boost::asio::awaitable<void> saveBookImagePeriodically();
+  void saveBookImage();
   void onIncrementalUpdate(IncrementalUpdate&& incrementalUpdate);
+  void onIncrementalUpdates(std::vector<IncrementalUpdate>& incrementalUpdates);
+  void requestSnapshotIfNeeded();
+  void applyIncrementalUpdate(IncrementalUpdate&& incrementalUpdate);
+  // Disconnects when the book missed updates or no longer matches the
+  // feed's checksum, returns true if it did.
+  bool resyncIfDiverged();
+  SnapshotResponse getHistoricalSnapshot(const SnapshotQuery& snapshotQuery);
+  // order counts per level or one order's queue position
+  SnapshotResponse getOrderSnapshot(const SnapshotQuery& snapshotQuery);
+  SnapshotResponse getTopOfBook(const SnapshotQuery& snapshotQuery);
   void onSnapshot(OrderBookSnapshot&& orderBookSnapshot);
 
  public:
   OrderBookNetworkConnector(std::string_view host, std::string_view port,
-                            int reconnectDelay, bool useLock);
+                            int reconnectDelay, bool useLock,
+                            std::vector<PriceType> bucketSizes = {},
+                            UpdateBatchingOptions updateBatchingOptions = {},
+                            FeedThreadOptions feedThreadOptions = {},
+                            FeedAdapterVariant feedAdapter = {},
+                            std::string_view symbol = {},
+                            FeedCompressionOptions feedCompressionOptions = {},
+                            std::size_t checksumDepth =
+                                book_checksum::DEFAULT_DEPTH);
   ~OrderBookNetworkConnector();
-  std::string getSnapshot();
+  // Records applied updates and periodic checkpoints under `directory` so
+  // past states can be rebuilt, see BookHistory.h.
+  void enableHistory(std::string_view directory,
+                     std::chrono::milliseconds checkpointInterval);
+  // Saves the book to a memory mapped image at `path` periodically and on
+  // SIGINT/SIGTERM, and restores it on startup when one exists.
+  void enableBookImage(const std::string& path,
+                       std::chrono::milliseconds interval);
+  // Runs `topOfBookCallback` on the feed thread whenever the best bid or ask
+  // changes, call before run().
+  void addTopOfBookCallback(TopOfBookCallback topOfBookCallback);
+  SnapshotResponse getSnapshot(const SnapshotQuery& snapshotQuery);
+  const std::string& getSymbol() const { return m_symbol; }
   void run();
 };
\ No newline at end of file
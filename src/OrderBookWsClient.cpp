@@ -1,86 +1,86 @@
 #include "OrderBookWsClient.h"
 
+#include <cerrno>
+#include <chrono>
 #include <cstdlib>
+#include <cstring>
 #include <format>
 #include <iostream>
+#include <limits>
 #include <memory>
 #include <nlohmann/json.hpp>
 #include <string>
+#include <variant>
 
 #include "AsyncIOHeaders.h"
+#include "IncrementalUpdateBatch.hpp"
 #include "OrderBook.hpp"
 #include "common_header.h"
 #include "json_utils.h"
 #include "logging.h"
+#include "utils.h"
 
+// Unlimited rate policy of the feed stream that counts bytes taken off the
+// socket, i.e. what crossed the wire before any inflation.
+class WireByteCounter {
+  friend class beast::rate_policy_access;
+  static constexpr auto ALL = std::numeric_limits<std::size_t>::max();
+  std::size_t m_readBytes{0};
+
+  std::size_t available_read_bytes() const noexcept { return ALL; }
+  std::size_t available_write_bytes() const noexcept { return ALL; }
+  void transfer_read_bytes(std::size_t bytes) noexcept { m_readBytes += bytes; }
+  void transfer_write_bytes(std::size_t) const noexcept {}
+  void on_timer() const noexcept {}
+
+ public:
+  std::size_t getReadBytes() const { return m_readBytes; }
+};
+
+using FeedStream =
+    beast::basic_stream<tcp, asio::any_io_executor, WireByteCounter>;
+
+// One websocket connection as a single coroutine, from resolve to the last
+// read. The coroutine frames and the state of every operation it awaits are
+// recycled by asio's per thread handler memory cache, the read loop does no
+// heap allocation once it is running.
 class WebSocketClient : public std::enable_shared_from_this<WebSocketClient> {
-  asio::io_context& m_ioc;
   DataCallback m_dataCallback;
-  DisconnectCallback m_disconnectCallback;
+  // called once no further bytes are waiting in the socket
+  std::function<void()> m_readIdleCallback;
   std::string m_host;
   std::string m_port;
   std::string m_uri;
-  std::string m_text;
+  int m_socketBusyPollMicros;
+  FeedCompressionOptions m_compressionOptions;
   bool m_stopFlag;
+  bool m_connected;
+  bool m_reading;
 
   tcp::resolver m_resolver;
-  websocket::stream<beast::tcp_stream> m_tcpStream;
+  websocket::stream<FeedStream> m_tcpStream;
+  // inflated payloads land here, its capacity is kept across reads
   beast::flat_buffer buffer;
 
- public:
-  explicit WebSocketClient(asio::io_context& ioc, DataCallback dataCallback,
-                           DisconnectCallback disconnectCallback,
-                           std::string_view host, std::string_view port,
-                           std::string_view uri)
-      : m_ioc{ioc},
-        m_dataCallback{dataCallback},
-        m_disconnectCallback{[this, disconnectCallback]() {
-          if (m_stopFlag) {
-            return;
-          }
-          disconnectCallback();
-        }},
-        m_host{host},
-        m_port{port},
-        m_uri{uri},
-        m_stopFlag{false},
-        m_resolver{asio::make_strand(ioc)},
-        m_tcpStream{asio::make_strand(ioc)} {}
-
-  // Start the asynchronous operation
-  void run(std::string_view text) {
-    // Look up the domain name first
-    m_resolver.async_resolve(
-        m_host, m_port,
-        beast::bind_front_handler(&WebSocketClient::onResolve,
-                                  shared_from_this()));
-  }
-
-  void onResolve(beast::error_code ec, tcp::resolver::results_type results) {
-    m_resolver.cancel();
-    if (ec) {
-      LOG_ERROR("resolve failed: " << ec.message());
-      m_disconnectCallback();
-      return;
-    }
-
-    // Set the timeout for the operation
-    beast::get_lowest_layer(m_tcpStream)
-        .expires_after(std::chrono::seconds(30));
-
-    // Make the connection on the IP address we get from a lookup
-    beast::get_lowest_layer(m_tcpStream)
-        .async_connect(results,
-                       beast::bind_front_handler(&WebSocketClient::onConnect,
-                                                 shared_from_this()));
-  }
+  struct ReadStatistics {
+    std::size_t messages{0};
+    std::size_t wireBytes{0};
+    std::size_t payloadBytes{0};
+    std::chrono::nanoseconds cpuTime{0};
+  };
+  ReadStatistics m_readStatistics;
+  std::size_t m_wireBytesReported{0};
+  std::chrono::steady_clock::time_point m_statisticsStart;
 
-  void onConnect(beast::error_code ec,
-                 tcp::resolver::results_type::endpoint_type ep) {
-    if (ec) {
-      LOG_ERROR("connect failed: " << ec.message());
-      m_disconnectCallback();
-      return;
+  void setSocketOptions() {
+    if (m_socketBusyPollMicros > 0) {
+      auto& socket = beast::get_lowest_layer(m_tcpStream).socket();
+      if (setSocketBusyPoll(socket.native_handle(), m_socketBusyPollMicros)) {
+        LOG_INFO("SO_BUSY_POLL set to " << m_socketBusyPollMicros << " us");
+      } else {
+        // raising it above net.core.busy_poll needs CAP_NET_ADMIN
+        LOG_WARN("Cannot set SO_BUSY_POLL: " << std::strerror(errno));
+      }
     }
 
     // Turn off the timeout on the tcp_stream, because
@@ -91,6 +91,17 @@ class WebSocketClient : public std::enable_shared_from_this<WebSocketClient> {
     m_tcpStream.set_option(
         websocket::stream_base::timeout::suggested(beast::role_type::client));
 
+    if (m_compressionOptions.deflate) {
+      // only the server's window and context matter for what we inflate
+      websocket::permessage_deflate permessageDeflate;
+      permessageDeflate.client_enable = true;
+      permessageDeflate.server_max_window_bits =
+          m_compressionOptions.windowBits;
+      permessageDeflate.server_no_context_takeover =
+          m_compressionOptions.noContextTakeover;
+      m_tcpStream.set_option(permessageDeflate);
+    }
+
     // Set a decorator to change the User-Agent of the handshake
     m_tcpStream.set_option(
         websocket::stream_base::decorator([](websocket::request_type& req) {
@@ -98,175 +109,325 @@ class WebSocketClient : public std::enable_shared_from_this<WebSocketClient> {
                   std::string(BOOST_BEAST_VERSION_STRING) +
                       " websocket-client-async");
         }));
-
-    // Update the host_ string. This will provide the value of the
-    // Host HTTP header during the WebSocket handshake.
-    // See https://tools.ietf.org/html/rfc7230#section-5.4
-    m_host += ':' + std::to_string(ep.port());
-    LOG_INFO("starting handshake m_host: " << m_host);
-
-    // Perform the websocket handshake
-    m_tcpStream.async_handshake(
-        m_host, m_uri,
-        beast::bind_front_handler(&WebSocketClient::onHandshake,
-                                  shared_from_this()));
   }
 
-  void onHandshake(beast::error_code ec) {
-    LOG_INFO("on handshake, ec: " << ec);
-    if (ec) {
-      LOG_ERROR("Web socket handshake failed: " << ec.message());
-      m_disconnectCallback();
+  // CPU from starting a read to its completion covers the receive syscalls,
+  // frame decoding and, when negotiated, inflation. The JSON parse is not
+  // part of it.
+  void recordRead(std::chrono::nanoseconds cpuTimeBefore) {
+    m_readStatistics.cpuTime += getThreadCpuTime() - cpuTimeBefore;
+    ++m_readStatistics.messages;
+    m_readStatistics.payloadBytes += buffer.size();
+    auto now = std::chrono::steady_clock::now();
+    if (now - m_statisticsStart < m_compressionOptions.statsInterval) {
       return;
     }
+    auto wireBytes =
+        beast::get_lowest_layer(m_tcpStream).rate_policy().getReadBytes();
+    m_readStatistics.wireBytes = wireBytes - m_wireBytesReported;
+    reportReadStatistics(now - m_statisticsStart);
+    m_wireBytesReported = wireBytes;
+    m_readStatistics = {};
+    m_statisticsStart = now;
+  }
 
-    // Send the message
-    m_tcpStream.async_write(asio::buffer(m_text),
-                            beast::bind_front_handler(&WebSocketClient::onWrite,
-                                                      shared_from_this()));
+  void reportReadStatistics(std::chrono::steady_clock::duration elapsed) {
+    const auto& statistics = m_readStatistics;
+    auto seconds = std::chrono::duration<double>(elapsed).count();
+    auto messages = std::max<std::size_t>(statistics.messages, 1);
+    LOG_INFO(std::format(
+        "websocket reads: {:.0f} messages/s, wire {:.3f} MB/s, payload "
+        "{:.3f} MB/s, ratio {:.2f}, {:.2f} us cpu per message ({})",
+        statistics.messages / seconds, statistics.wireBytes / seconds / 1e6,
+        statistics.payloadBytes / seconds / 1e6,
+        statistics.wireBytes > 0
+            ? static_cast<double>(statistics.payloadBytes) /
+                  statistics.wireBytes
+            : 0.0,
+        std::chrono::duration<double, std::micro>(statistics.cpuTime)
+                .count() /
+            messages,
+        m_compressionOptions.deflate ? "permessage-deflate offered"
+                                     : "uncompressed"));
   }
 
-  void onWrite(beast::error_code ec, std::size_t bytes_transferred) {
-    LOG_INFO("done writing, ec: " << ec);
-    boost::ignore_unused(bytes_transferred);
+  void onFrame() {
+    m_dataCallback(
+        {static_cast<const char*>(buffer.data().data()), buffer.size()});
+    buffer.consume(buffer.size());
 
-    if (ec) {
-      LOG_ERROR("writing data on websocket failed: " << ec.message());
-      m_disconnectCallback();
-      return;
+    if (m_readIdleCallback) {
+      // Frames beast already pulled into its own buffer are not counted
+      // here, so a batch may end a little early but never waits for data.
+      beast::error_code availableEc;
+      auto available = beast::get_lowest_layer(m_tcpStream)
+                           .socket()
+                           .available(availableEc);
+      if (availableEc || available == 0) {
+        m_readIdleCallback();
+      }
     }
-
-    // Read a message into our buffer
-    m_tcpStream.async_read(buffer,
-                           beast::bind_front_handler(&WebSocketClient::onRead,
-                                                     shared_from_this()));
   }
 
-  void onRead(beast::error_code ec, std::size_t bytes_transferred) {
-    boost::ignore_unused(bytes_transferred);
+ public:
+  explicit WebSocketClient(asio::io_context& ioc, DataCallback dataCallback,
+                           std::function<void()> readIdleCallback,
+                           std::string_view host, std::string_view port,
+                           std::string_view uri, int socketBusyPollMicros,
+                           FeedCompressionOptions compressionOptions)
+      : m_dataCallback{dataCallback},
+        m_readIdleCallback{readIdleCallback},
+        m_host{host},
+        m_port{port},
+        m_uri{uri},
+        m_socketBusyPollMicros{socketBusyPollMicros},
+        m_compressionOptions{compressionOptions},
+        m_stopFlag{false},
+        m_connected{false},
+        m_reading{false},
+        // no strand, the session coroutine already serializes its
+        // operations and wrapping one in any_io_executor allocates per await
+        m_resolver{ioc.get_executor()},
+        m_tcpStream{ioc.get_executor()} {}
+
+  // Connects, sends `text` and delivers frames until the connection fails
+  // or is stopped, failures are logged and end the session.
+  asio::awaitable<void> run(std::string_view text) {
+    // keeps this alive for the whole session, not per operation
+    auto self = shared_from_this();
+    const char* step = "resolve";
+    try {
+      auto results = co_await m_resolver.async_resolve(m_host, m_port,
+                                                       asio::use_awaitable);
 
-    if (ec) {
-      LOG_ERROR("Reading data from websocket failed: " << ec.message());
-      m_disconnectCallback();
-      return;
-    }
+      step = "connect";
+      beast::get_lowest_layer(m_tcpStream)
+          .expires_after(std::chrono::seconds(30));
+      auto endpoint = co_await beast::get_lowest_layer(m_tcpStream)
+                          .async_connect(results, asio::use_awaitable);
+      setSocketOptions();
 
-    // LOG_INFO("Received data on webSocekt, buffer.data().size(): "
-    //          << buffer.data().size() << " "
-    //          << beast::make_printable(buffer.data()) << std::endl);
-    m_dataCallback(
-        {static_cast<const char*>(buffer.data().data()), buffer.size()});
-    buffer.consume(buffer.size());
+      // Update the host_ string. This will provide the value of the
+      // Host HTTP header during the WebSocket handshake.
+      // See https://tools.ietf.org/html/rfc7230#section-5.4
+      m_host += ':' + std::to_string(endpoint.port());
+      LOG_INFO("starting handshake m_host: " << m_host);
+      step = "Web socket handshake";
+      websocket::response_type response;
+      co_await m_tcpStream.async_handshake(response, m_host, m_uri,
+                                           asio::use_awaitable);
+      m_connected = true;
+      if (m_compressionOptions.deflate) {
+        if (auto extensions = response[http::field::sec_websocket_extensions];
+            !extensions.empty()) {
+          LOG_INFO("Negotiated websocket extensions: " << extensions);
+        } else {
+          LOG_WARN("Server declined permessage-deflate, frames are read "
+                   "uncompressed");
+        }
+      }
+
+      step = "writing data on websocket";
+      co_await m_tcpStream.async_write(asio::buffer(text),
+                                       asio::use_awaitable);
 
-    m_tcpStream.async_read(buffer,
-                           beast::bind_front_handler(&WebSocketClient::onRead,
-                                                     shared_from_this()));
+      step = "Reading data from websocket";
+      bool measure = m_compressionOptions.statsInterval.count() > 0;
+      m_statisticsStart = std::chrono::steady_clock::now();
+      while (!m_stopFlag) {
+        m_reading = true;
+        auto cpuTimeBefore =
+            measure ? getThreadCpuTime() : std::chrono::nanoseconds{0};
+        co_await m_tcpStream.async_read(buffer, asio::use_awaitable);
+        m_reading = false;
+        if (measure) {
+          recordRead(cpuTimeBefore);
+        }
+        onFrame();
+      }
+    } catch (const boost::system::system_error& ex) {
+      if (!m_stopFlag) {
+        LOG_ERROR(step << " failed: " << ex.code().message());
+      }
+    }
+    m_reading = false;
+    if (m_stopFlag && m_connected) {
+      co_await close();
+    }
+    m_connected = false;
+    LOG_INFO("websocket session ended, buffer size is: "
+             << buffer.data().size());
   }
 
-  void onClose(beast::error_code ec) {
-    LOG_INFO("closed, ec: " << ec);
-    if (ec) {
-      LOG_ERROR("Closing websocket connection failed: " << ec.message());
+  asio::awaitable<void> close() {
+    m_connected = false;
+    try {
+      co_await m_tcpStream.async_close(websocket::close_code::normal,
+                                       asio::use_awaitable);
+    } catch (const boost::system::system_error& ex) {
+      LOG_ERROR("Closing websocket connection failed: " << ex.code().message());
     }
-    LOG_INFO("at close buffer size is: " << buffer.data().size());
-    m_ioc.stop();
   }
 
-  void stop(bool withStopFlag = true) {
-    // Close the WebSocket connection
-    LOG_INFO("closing withStopFlag: " << withStopFlag
-                                      << " m_stopFlag: " << m_stopFlag);
+  // Ends the session, a pending resolve, connect or read completes with an
+  // error and run() returns.
+  void stop() {
+    LOG_INFO("closing m_stopFlag: " << m_stopFlag);
     if (m_stopFlag) {
       return;
     }
-    if (withStopFlag) {
-      m_stopFlag = true;
+    m_stopFlag = true;
+    if (!m_connected) {
+      beast::error_code ec;
+      m_resolver.cancel();
+      beast::get_lowest_layer(m_tcpStream).socket().close(ec);
+      return;
+    }
+    if (!m_reading) {
+      // between operations, e.g. inside a frame callback, run() closes the
+      // connection as soon as the current one completes
+      return;
     }
-    m_tcpStream.async_close(websocket::close_code::normal,
-                            beast::bind_front_handler(&WebSocketClient::onClose,
-                                                      shared_from_this()));
+    // the close handshake completes the pending read
+    asio::co_spawn(
+        m_tcpStream.get_executor(),
+        [self = shared_from_this()]() { return self->close(); },
+        asio::detached);
   }
 };
 
 OrderBookWsClient::OrderBookWsClient(
+    const FeedAdapterVariant& feedAdapter, std::string_view symbol,
     IncrementalUpdateCallback incrementalUpdateCallback,
-    DisconnectCallback disconnectCallback, boost::asio::io_context& ioc,
-    std::string_view host, std::string_view port, std::string_view uri)
+    IncrementalUpdateBatchCallback incrementalUpdateBatchCallback,
+    boost::asio::io_context& ioc, std::string_view host, std::string_view port,
+    UpdateBatchingOptions updateBatchingOptions, int socketBusyPollMicros,
+    FeedCompressionOptions compressionOptions)
     : m_host{host},
       m_port{port},
-      m_uri{uri},
+      m_uri{std::visit(
+          [](auto adapter) {
+            return std::string(decltype(adapter)::WS_URI);
+          },
+          feedAdapter)},
+      m_subscriptionRequestJson{std::visit(
+          [&](auto adapter) {
+            return decltype(adapter)::subscriptionRequest(symbol);
+          },
+          feedAdapter)},
       m_incrementalUpdateCallback{incrementalUpdateCallback},
-      m_disconnectCallback{disconnectCallback},
+      m_incrementalUpdateBatchCallback{incrementalUpdateBatchCallback},
+      m_updateBatchingOptions{updateBatchingOptions},
+      m_incrementalUpdateBatch{
+          updateBatchingOptions.enabled
+              ? std::make_unique<IncrementalUpdateBatch>(
+                    updateBatchingOptions.conflate)
+              : nullptr},
       m_webSocketClient{std::make_shared<WebSocketClient>(
           ioc,
-          [&](std::string_view jsonData) {
+          std::visit(
+              [&](auto adapter) {
+                return DataCallback([this](std::string_view jsonData) {
+                  onFrame<decltype(adapter)>(jsonData);
+                });
+              },
+              feedAdapter),
+          updateBatchingOptions.enabled ? std::function<void()>([&]() {
             try {
-              try {
-                IncrementalUpdate incrementalUpdate;
-                jsonToIncrementalUpdate(jsonData, incrementalUpdate);
-                m_incrementalUpdateCallback(std::move(incrementalUpdate));
-              } catch (const std::exception& ex) {
-                LOG_ERROR(
-                    "Failed to process message received from websocket, "
-                    "exception: "
-                    << ex.what());
-                LOG_INFO("message received from websocket:" << jsonData);
-                bool withStopFlag = false;
-                m_webSocketClient->stop(withStopFlag);
-              } catch (...) {
-                LOG_ERROR(
-                    "Unknown exception, Failed to process message received "
-                    "from websocket");
-                LOG_INFO("message received from websocket: : " << jsonData);
-                bool withStopFlag = false;
-                m_webSocketClient->stop(withStopFlag);
-              }
-            } catch (...) {
-              bool withStopFlag = false;
-              m_webSocketClient->stop(withStopFlag);
+              flushIncrementalUpdateBatch();
+            } catch (const std::exception& ex) {
+              LOG_ERROR("Failed to apply batch of incremental updates, "
+                        "exception: "
+                        << ex.what());
+              m_webSocketClient->stop();
             }
-          },
-          disconnectCallback, host, port, uri)} {
-  m_subscriptionRequestJson =
-      "{\n"
-      "   \"id\": 1545910660739,\n"
-      "   \"type\": \"subscribe\",\n"
-      "   \"topic\": \"/market/level2:BTC-USDT\",\n"
-      "   \"response\": true\n"
-      "}\n";
+          })
+                                        : nullptr,
+          host, port, m_uri, socketBusyPollMicros, compressionOptions)} {}
+
+template <typename FeedAdapter>
+void OrderBookWsClient::onFrame(std::string_view jsonData) {
+  try {
+    try {
+      IncrementalUpdate incrementalUpdate;
+      incrementalUpdate.receiveTimestamp =
+          std::chrono::duration_cast<std::chrono::nanoseconds>(
+              std::chrono::system_clock::now().time_since_epoch());
+      if (!FeedAdapter::parseIncrementalUpdate(jsonData, incrementalUpdate)) {
+        LOG_INFO("Ignoring message received from websocket: " << jsonData);
+        return;
+      }
+      onIncrementalUpdate(std::move(incrementalUpdate));
+    } catch (const std::exception& ex) {
+      LOG_ERROR(
+          "Failed to process message received from websocket, "
+          "exception: "
+          << ex.what());
+      LOG_INFO("message received from websocket:" << jsonData);
+      m_webSocketClient->stop();
+    } catch (...) {
+      LOG_ERROR(
+          "Unknown exception, Failed to process message received "
+          "from websocket");
+      LOG_INFO("message received from websocket: : " << jsonData);
+      m_webSocketClient->stop();
+    }
+  } catch (...) {
+    m_webSocketClient->stop();
+  }
 }
 
-void OrderBookWsClient::run() {
+asio::awaitable<void> OrderBookWsClient::run() {
   LOG_INFO("Running OrderBookWsClient");
-  m_webSocketClient->run(m_subscriptionRequestJson);
+  // stop() drops m_webSocketClient while the session may still be running
+  auto webSocketClient = m_webSocketClient;
+  co_await webSocketClient->run(m_subscriptionRequestJson);
 }
 
 void OrderBookWsClient::stop() {
   if (!m_webSocketClient) {
     return;
   }
+  if (m_incrementalUpdateBatch) {
+    LOG_INFO("Applied " << m_totalFrames << " frames in " << m_totalBatches
+                        << " batches, largest batch " << m_largestBatch
+                        << " frames");
+  }
   m_webSocketClient->stop();
   m_webSocketClient.reset();
 }
 
-void OrderBookWsClient::jsonToIncrementalUpdate(
-    std::string_view json, IncrementalUpdate& incrementalUpdate) {
-  nlohmann::json jsonIncrementalUpdate = nlohmann::json::parse(json)["data"];
-  incrementalUpdate.timestamp =
-      TimePoint(jsonIncrementalUpdate["time"].get<long>());
-  incrementalUpdate.sequenceStart =
-      jsonIncrementalUpdate["sequenceStart"].get<std::size_t>();
-  incrementalUpdate.sequenceEnd =
-      jsonIncrementalUpdate["sequenceEnd"].get<std::size_t>();
-  bool withSequence = true;
-  const auto& jsonBids = jsonIncrementalUpdate["changes"]["bids"]
-                             .template get<std::vector<nlohmann::json>>();
-  JsonUtils::populatePriceLevels(incrementalUpdate.bids, jsonBids,
-                                 withSequence);
-  const auto& jsonAsks = jsonIncrementalUpdate["changes"]["asks"]
-                             .template get<std::vector<nlohmann::json>>();
-  JsonUtils::populatePriceLevels(incrementalUpdate.asks, jsonAsks,
-                                 withSequence);
+void OrderBookWsClient::onIncrementalUpdate(
+    IncrementalUpdate&& incrementalUpdate) {
+  if (!m_incrementalUpdateBatch) {
+    m_incrementalUpdateCallback(std::move(incrementalUpdate));
+    return;
+  }
+  m_incrementalUpdateBatch->add(std::move(incrementalUpdate));
+  if (++m_batchFrames >= m_updateBatchingOptions.maxFrames) {
+    flushIncrementalUpdateBatch();
+  }
+}
+
+void OrderBookWsClient::flushIncrementalUpdateBatch() {
+  if (!m_incrementalUpdateBatch || m_incrementalUpdateBatch->empty()) {
+    return;
+  }
+  LOG_DEBUG("Flushing batch of " << m_batchFrames << " frames as "
+                                 << m_incrementalUpdateBatch->size()
+                                 << " updates");
+  m_totalFrames += m_batchFrames;
+  m_largestBatch = std::max(m_largestBatch, m_batchFrames);
+  ++m_totalBatches;
+  m_batchFrames = 0;
+  try {
+    m_incrementalUpdateBatchCallback(m_incrementalUpdateBatch->getUpdates());
+  } catch (...) {
+    // a failed batch must not be applied again with the next one
+    m_incrementalUpdateBatch->clear();
+    throw;
+  }
+  m_incrementalUpdateBatch->clear();
 }
 
 OrderBookWsClient::~OrderBookWsClient() = default;
\ No newline at end of file
@@ -1,9 +1,14 @@
 #pragma once
 
+#include <boost/asio/awaitable.hpp>
 #include <functional>
 #include <memory>
 #include <string>
 #include <utility>
+#include <vector>
+
+#include "FeedAdapters.hpp"
+#include "common_header.h"
 
 namespace boost {
 namespace asio {
@@ -11,12 +16,12 @@ class io_context;
 }
 }  // namespace boost
 
-class OrderBookSnapshot;
-class IncrementalUpdate;
 class WebSocketClient;
+class IncrementalUpdateBatch;
 
 using IncrementalUpdateCallback = std::function<void(IncrementalUpdate&&)>;
-using DisconnectCallback = std::function<void()>;
+using IncrementalUpdateBatchCallback =
+    std::function<void(std::vector<IncrementalUpdate>&)>;
 
 class OrderBookWsClient {
   std::string m_host;
@@ -24,18 +29,34 @@ class OrderBookWsClient {
   std::string m_uri;
   std::string m_subscriptionRequestJson;
   IncrementalUpdateCallback m_incrementalUpdateCallback;
-  DisconnectCallback m_disconnectCallback;
+  IncrementalUpdateBatchCallback m_incrementalUpdateBatchCallback;
+  UpdateBatchingOptions m_updateBatchingOptions;
+  std::unique_ptr<IncrementalUpdateBatch> m_incrementalUpdateBatch;
+  std::size_t m_batchFrames{0};
+  std::size_t m_totalFrames{0};
+  std::size_t m_totalBatches{0};
+  std::size_t m_largestBatch{0};
   std::shared_ptr<WebSocketClient> m_webSocketClient;
 
-  void jsonToIncrementalUpdate(std::string_view json,
-                               IncrementalUpdate& incrementalUpdate);
+  template <typename FeedAdapter>
+  void onFrame(std::string_view jsonData);
+  void onIncrementalUpdate(IncrementalUpdate&& incrementalUpdate);
+  void flushIncrementalUpdateBatch();
 
  public:
-  OrderBookWsClient(IncrementalUpdateCallback incrementalUpdateCallback,
-                    DisconnectCallback disconnectCallback,
-                    boost::asio::io_context& ioc, std::string_view host,
-                    std::string_view port, std::string_view uri);
-  void run();
+  // Frames are parsed by the adapter held in `feedAdapter`, it is looked at
+  // once here rather than for every frame.
+  OrderBookWsClient(
+      const FeedAdapterVariant& feedAdapter, std::string_view symbol,
+      IncrementalUpdateCallback incrementalUpdateCallback,
+      IncrementalUpdateBatchCallback incrementalUpdateBatchCallback,
+      boost::asio::io_context& ioc, std::string_view host,
+      std::string_view port,
+      UpdateBatchingOptions updateBatchingOptions = {},
+      int socketBusyPollMicros = 0,
+      FeedCompressionOptions compressionOptions = {});
+  // Completes when the connection is lost or stopped.
+  boost::asio::awaitable<void> run();
   void stop();
   ~OrderBookWsClient();
 };
\ No newline at end of file
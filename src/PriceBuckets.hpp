@@ -0,0 +1,91 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+
+#include "common_header.h"
+
+// Aggregated view of one side pair of the book grouped into fixed width price
+// buckets. It is maintained from every level change, so serving a bucketed
+// book never needs a pass over the raw depth.
+class PriceBucketView {
+  // Buckets are keyed by integer index (price / bucketSize) so that bucket
+  // identity does not depend on floating point equality of bucket prices.
+  using BucketIndex = std::int64_t;
+
+  struct Bucket {
+    SizeType size{0};
+    std::size_t levelCount{0};
+  };
+
+  // Guards against 3988.6 / 0.1 landing on 39885.999999 instead of 39886.
+  static constexpr double BUCKET_INDEX_TOLERANCE = 1e-9;
+
+  PriceType m_bucketSize;
+  std::map<BucketIndex, Bucket, std::greater<BucketIndex>> m_bids;
+  std::map<BucketIndex, Bucket> m_asks;
+
+  template <typename BucketsType>
+  static void applyChange(BucketsType& buckets, BucketIndex index,
+                          SizeType oldSize, SizeType newSize) {
+    auto& bucket = buckets[index];
+    if (oldSize == 0) {
+      ++bucket.levelCount;
+    }
+    if (newSize == 0) {
+      --bucket.levelCount;
+    }
+    if (bucket.levelCount == 0) {
+      // drop the bucket instead of keeping a residue of rounding errors
+      buckets.erase(index);
+      return;
+    }
+    bucket.size += newSize - oldSize;
+  }
+
+  template <typename BucketsType>
+  void collect(const BucketsType& buckets, std::size_t depth,
+               BucketLevels& levels) const {
+    levels.reserve(depth == 0 ? std::size(buckets)
+                              : std::min(depth, std::size(buckets)));
+    for (const auto& [index, bucket] : buckets) {
+      if (depth != 0 && std::size(levels) >= depth) {
+        break;
+      }
+      levels.push_back({.price = static_cast<PriceType>(index) * m_bucketSize,
+                        .size = bucket.size,
+                        .levelCount = bucket.levelCount});
+    }
+  }
+
+ public:
+  explicit PriceBucketView(PriceType bucketSize) : m_bucketSize{bucketSize} {}
+
+  PriceType getBucketSize() const { return m_bucketSize; }
+
+  // Bids round down and asks round up, so a bucket never advertises a better
+  // price than any of the levels it holds.
+  void onLevelChange(BidOrAsk bidOrAsk, PriceType price, SizeType oldSize,
+                     SizeType newSize) {
+    if (bidOrAsk == BidOrAsk::BID) {
+      auto index = static_cast<BucketIndex>(
+          std::floor(price / m_bucketSize + BUCKET_INDEX_TOLERANCE));
+      applyChange(m_bids, index, oldSize, newSize);
+    } else {
+      auto index = static_cast<BucketIndex>(
+          std::ceil(price / m_bucketSize - BUCKET_INDEX_TOLERANCE));
+      applyChange(m_asks, index, oldSize, newSize);
+    }
+  }
+
+  // depth of 0 means all buckets
+  void getLevels(std::size_t depth, BucketLevels& bids,
+                 BucketLevels& asks) const {
+    collect(m_bids, depth, bids);
+    collect(m_asks, depth, asks);
+  }
+};
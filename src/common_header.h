@@ -1,9 +1,12 @@
 #pragma once
 
 #include <chrono>
+#include <cstdint>
 #include <functional>
 #include <map>
+#include <optional>
 #include <queue>
+#include <string>
 #include <vector>
 
 const double PRICE_COMPARISION_TOLERANCE = 1e-12;
@@ -25,6 +28,14 @@ struct Level {
 
 using Levels = std::vector<Level>;
 
+struct BucketLevel {
+  PriceType price{0};
+  SizeType size{0};
+  std::size_t levelCount{0};
+};
+
+using BucketLevels = std::vector<BucketLevel>;
+
 struct PriceCompareLessThan {
   bool operator()(const PriceType& lhs, const PriceType& rhs) const;
 };
@@ -38,11 +49,67 @@ using BidLevels = std::map<PriceType, Level, PriceCompareGreaterThan>;
 
 enum struct BidOrAsk { BID, ASK };
 
+// Order level (L3) feed events, see MarketByOrder.hpp.
+enum struct OrderAction { ADD, MODIFY, REMOVE };
+
+struct OrderEvent {
+  OrderAction action{OrderAction::ADD};
+  std::uint64_t orderId{0};
+  BidOrAsk side{BidOrAsk::BID};
+  PriceType price{0};
+  // remaining size of the order, unused by REMOVE
+  SizeType size{0};
+  SequenceType sequence{0};
+};
+
+using OrderEvents = std::vector<OrderEvent>;
+
+struct OrderCountLevel {
+  PriceType price{0};
+  SizeType size{0};
+  std::size_t orderCount{0};
+};
+
+using OrderCountLevels = std::vector<OrderCountLevel>;
+
+struct OrderCountSnapshot {
+  SequenceType sequence{0};
+  TimePoint timestamp{0};
+  OrderCountLevels bids;
+  OrderCountLevels asks;
+};
+
+// Where a resting order stands in the FIFO of its price level.
+struct QueuePosition {
+  std::uint64_t orderId{0};
+  BidOrAsk side{BidOrAsk::BID};
+  PriceType price{0};
+  SizeType size{0};
+  std::size_t ordersAhead{0};
+  SizeType sizeAhead{0};
+  std::size_t levelOrderCount{0};
+  SizeType levelSize{0};
+  SequenceType sequence{0};
+};
+
 struct OrderBookSnapshot {
   SequenceType sequence;
   TimePoint timestamp;
   Levels bids;
   Levels asks;
+  // CRC32 of the top of the book, see BookChecksum.hpp
+  std::optional<std::uint32_t> checksum;
+  // resting orders in priority order for market by order feeds, the levels
+  // are derived from them
+  OrderEvents orders;
+};
+
+struct BucketedSnapshot {
+  PriceType bucketSize{0};
+  SequenceType sequence{0};
+  TimePoint timestamp{0};
+  BucketLevels bids;
+  BucketLevels asks;
 };
 
 struct IncrementalUpdate {
@@ -51,6 +118,88 @@ struct IncrementalUpdate {
   TimePoint timestamp;
   Levels bids;
   Levels asks;
+  // checksum of the book after this update, for feeds that publish one
+  std::optional<std::uint32_t> checksum;
+  // order events of market by order feeds, the book turns them into `bids`
+  // and `asks` when it applies the update
+  OrderEvents orders;
+  // wall clock time the frame carrying the update was read, since epoch
+  std::chrono::nanoseconds receiveTimestamp{0};
 };
 
-using DataCallback = std::function<void(std::string_view)>;
\ No newline at end of file
+// Best bid and ask, published whenever either price or size changes. A
+// side without levels has price and size 0.
+struct TopOfBook {
+  SequenceType sequence{0};
+  // exchange time of the update that changed it
+  TimePoint timestamp{0};
+  // see IncrementalUpdate::receiveTimestamp
+  std::chrono::nanoseconds receiveTimestamp{0};
+  PriceType bidPrice{0};
+  SizeType bidSize{0};
+  PriceType askPrice{0};
+  SizeType askSize{0};
+};
+
+// Runs on the feed thread right after the update is applied, while the
+// book is locked, it has to return quickly.
+using TopOfBookCallback = std::function<void(const TopOfBook&)>;
+
+using DataCallback = std::function<void(std::string_view)>;
+
+struct UpdateBatchingOptions {
+  // apply frames that were already waiting in the socket under one lock
+  bool enabled{false};
+  // upper bound of frames per batch, bounds book staleness during bursts
+  std::size_t maxFrames{256};
+  // merge contiguous updates of a batch into the net change per price
+  bool conflate{false};
+};
+
+struct FeedThreadOptions {
+  // core the feed thread is pinned to, -1 leaves it to the scheduler
+  int cpu{-1};
+  // spin on io_context::poll() instead of sleeping in epoll between frames
+  bool busyPoll{false};
+  // SO_BUSY_POLL microseconds set on the websocket, 0 leaves it unset
+  int socketBusyPollMicros{0};
+};
+
+struct FeedCompressionOptions {
+  // offer permessage-deflate when opening the feed websocket
+  bool deflate{false};
+  // largest LZ77 window (9..15 bits) the server may compress with, a smaller
+  // one needs less memory to inflate but compresses worse
+  int windowBits{15};
+  // ask the server to reset its compressor for every message
+  bool noContextTakeover{false};
+  // how often wire vs payload bytes and read CPU per message are logged,
+  // 0 disables the measurement
+  std::chrono::milliseconds statsInterval{0};
+};
+
+struct SnapshotQuery {
+  // book of a process serving several symbols, empty means its first one
+  std::string symbol;
+  // 0 means full depth
+  std::size_t depth{0};
+  // 0 means raw price levels
+  PriceType bucketSize{0};
+  // sequence (ETag) of the book the client already has
+  std::optional<SequenceType> ifNoneMatch;
+  // rebuild the book from recorded history instead of reading the live one
+  std::optional<SequenceType> atSequence;
+  std::optional<TimePoint> atTimestamp;
+  // market by order books only: levels with their order counts, or the
+  // queue position of one order
+  bool orderCounts{false};
+  std::optional<std::uint64_t> queueOrderId;
+  // best bid and ask only, its ETag changes only when they do
+  bool topOfBook{false};
+};
+
+struct SnapshotResponse {
+  SequenceType sequence{0};
+  bool notModified{false};
+  std::string json;
+};
\ No newline at end of file
@@ -0,0 +1,137 @@
+#include <boost/program_options.hpp>
+#include <boost_http_server/server.hpp>
+#include <algorithm>
+#include <filesystem>
+#include <format>
+#include <iostream>
+#include <ranges>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "OrderBookGateway.h"
+#include "logging.h"
+
+namespace po = boost::program_options;
+
+// Serves many symbols from a pool of OrderBook worker processes behind one
+// http port, options it doesn't know are passed on to every worker.
+int main(int argc, char* argv[]) {
+  try {
+    po::options_description desc(
+        "Allowed options, any other option is passed to the OrderBook "
+        "workers (--host, --port, --feed, ...)");
+    desc.add_options()                    //
+        ("help", "produce help message")  //
+        ("symbols", po::value<std::string>()->required(),
+         "Comma separated symbols, each one is served by the worker the "
+         "consistent hash ring assigns it to, requests pick one with "
+         "symbol=<symbol>")  //
+        ("workers",
+         po::value<std::size_t>()->default_value(
+             std::max(1u, std::thread::hardware_concurrency())),
+         "Number of OrderBook worker processes, defaults to one per cpu")  //
+        ("orderbook", po::value<std::string>()->default_value(""),
+         "OrderBook executable the workers run, defaults to the one next to "
+         "this executable")  //
+        ("socket_dir",
+         po::value<std::string>()->default_value("/tmp/orderbook-gateway"),
+         "Directory of the Unix domain sockets the workers' http servers "
+         "listen on")  //
+        ("http_server_host", po::value<std::string>()->default_value("0.0.0.0"),
+         "Host the gateway's http server listens on")  //
+        ("http_server_port", po::value<int>()->default_value(48080),
+         "Port the gateway's http server listens on")  //
+        ("http_doc_dir",
+         po::value<std::string>()->default_value("../order_booker_web_content"),
+         "Top dir path to be used for serveing files over http.")  //
+        ("restart_delay", po::value<int>()->default_value(1000),
+         "Milliseconds before a worker that exited is started again")  //
+        ("max_restarts", po::value<std::size_t>()->default_value(5),
+         "Exits within restart_window after which a worker is given up and "
+         "its symbols move to the other workers")  //
+        ("restart_window", po::value<int>()->default_value(60000),
+         "Milliseconds over which max_restarts is counted")  //
+        ("request_timeout", po::value<int>()->default_value(2000),
+         "Milliseconds a worker may take to answer a forwarded request");
+
+    auto parsed = po::command_line_parser(argc, argv)
+                      .options(desc)
+                      .allow_unregistered()
+                      .run();
+    po::variables_map vm;
+    po::store(parsed, vm);
+
+    if (vm.count("help")) {
+      std::cout << desc << std::endl;
+      return 1;
+    }
+    po::notify(vm);
+
+    GatewayOptions gatewayOptions{
+        .orderBookPath = vm["orderbook"].as<std::string>(),
+        .workerCount = vm["workers"].as<std::size_t>(),
+        .socketDirectory = vm["socket_dir"].as<std::string>(),
+        .workerArguments =
+            po::collect_unrecognized(parsed.options, po::include_positional),
+        .restartDelay =
+            std::chrono::milliseconds(vm["restart_delay"].as<int>()),
+        .maxRestarts = vm["max_restarts"].as<std::size_t>(),
+        .restartWindow =
+            std::chrono::milliseconds(vm["restart_window"].as<int>()),
+        .requestTimeout =
+            std::chrono::milliseconds(vm["request_timeout"].as<int>())};
+    if (gatewayOptions.orderBookPath.empty()) {
+      gatewayOptions.orderBookPath =
+          (std::filesystem::read_symlink("/proc/self/exe").parent_path() /
+           "OrderBook")
+              .string();
+    }
+    for (auto symbol :
+         vm["symbols"].as<std::string>() | std::views::split(',')) {
+      if (!std::ranges::empty(symbol)) {
+        gatewayOptions.symbols.emplace_back(std::begin(symbol),
+                                            std::end(symbol));
+      }
+    }
+    if (gatewayOptions.symbols.empty()) {
+      LOG_ERROR("symbols must name at least one symbol");
+      std::cout << desc << std::endl;
+      return 1;
+    }
+    if (gatewayOptions.workerCount < 1) {
+      LOG_ERROR("workers must be at least 1");
+      std::cout << desc << std::endl;
+      return 1;
+    }
+    if (gatewayOptions.restartDelay.count() < 0 ||
+        gatewayOptions.restartWindow.count() < 0 ||
+        gatewayOptions.requestTimeout.count() < 1) {
+      LOG_ERROR("restart_delay and restart_window must not be negative, "
+                "request_timeout must be at least 1");
+      std::cout << desc << std::endl;
+      return 1;
+    }
+
+    OrderBookGateway orderBookGateway(gatewayOptions);
+    http::server::server httpServer(
+        vm["http_server_host"].as<std::string>(),
+        std::to_string(vm["http_server_port"].as<int>()),
+        vm["http_doc_dir"].as<std::string>(),
+        [&](std::string_view uri, const http::server::request& req,
+            http::server::reply& rep) {
+          try {
+            return orderBookGateway.handleApiRequest(uri, req, rep);
+          } catch (const std::exception& exp) {
+            LOG_ERROR("Request " << req.uri << " failed: " << exp.what());
+            throw;
+          }
+        });
+    std::jthread httpServerThread([&]() { httpServer.run(); });
+    orderBookGateway.run();
+  } catch (const std::exception& exp) {
+    std::cout << "exception occured: " << exp.what() << std::endl;
+    return 1;
+  }
+  return 0;
+}
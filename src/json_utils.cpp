@@ -6,63 +6,6 @@
 #include "OrderBook.hpp"
 #include "utils.h"
 
-void JsonUtils::populatePriceLevels(Levels& levels,
-                                    const nlohmann::json& jsonLevels,
-                                    bool withSequence) {
-  levels.reserve(std::size(jsonLevels));
-  for (const auto& jsonLevel : jsonLevels) {
-    const auto& bidSizeAndSequence = jsonLevel.get<std::vector<std::string>>();
-    if (withSequence) {
-      if (size(bidSizeAndSequence) != 3) {
-        auto error = std::format(
-            "Expect 3 elements in price level json array, but found {}, input "
-            "json array '{}'",
-            std::size(bidSizeAndSequence), jsonLevel.dump());
-        throw std::runtime_error(error);
-      }
-    } else {
-      if (size(bidSizeAndSequence) != 2) {
-        auto error = std::format(
-            "Expect 2 elements in price level json array, but found {}, input "
-            "json array '{}'",
-            std::size(bidSizeAndSequence), jsonLevel.dump());
-        throw std::runtime_error(error);
-      }
-    }
-    if (bidSizeAndSequence[0].empty()) {
-      auto error = std::format("Bid/Ask string is empty, input json array '{}'",
-                               jsonLevel.dump());
-      throw std::runtime_error(error);
-    }
-    if (bidSizeAndSequence[1].empty()) {
-      auto error = std::format("Size string is empty, input json array '{}'",
-                               jsonLevel.dump());
-      throw std::runtime_error(error);
-    }
-    if (bidSizeAndSequence[2].empty()) {
-      auto error = std::format(
-          "Sequence string is empty, input json array '{}'", jsonLevel.dump());
-      throw std::runtime_error(error);
-    }
-    levels.push_back({.price = std::stod(bidSizeAndSequence[0]),
-                      .size = std::stod(bidSizeAndSequence[1])});
-
-    if (withSequence) {
-      levels.back().sequence = std::stoull(bidSizeAndSequence[2]);
-    }
-
-    if (sizeCompareLessThan(levels.back().size, 0)) {
-      auto error = std::format("Size {} is less than 0", bidSizeAndSequence[0]);
-      throw std::runtime_error(error);
-    }
-    if (priceCompareLessThan(levels.back().price, 0)) {
-      auto error =
-          std::format("Price {} is less than 0", bidSizeAndSequence[0]);
-      throw std::runtime_error(error);
-    }
-  }
-}
-
 std::string JsonUtils::orderBookSnapshotToJson(const OrderBook& orderBook) {
   using namespace nlohmann;
   json snapshotJson = json::parse(
@@ -90,3 +33,112 @@ std::string JsonUtils::orderBookSnapshotToJson(const OrderBook& orderBook) {
   priceLevelSetter(orderBook.getAsks(), snapshotJson.at("asks"));
   return snapshotJson.dump();
 }
+
+std::string JsonUtils::orderBookSnapshotToJson(
+    const OrderBookSnapshot& orderBookSnapshot) {
+  using namespace nlohmann;
+  json snapshotJson = {
+      {"time", std::to_string(orderBookSnapshot.timestamp.count())},
+      {"sequence", std::to_string(orderBookSnapshot.sequence)},
+      {"bids", json::array()},
+      {"asks", json::array()}};
+  auto priceLevelSetter = [&](const Levels& levels, json& levelsJson) {
+    for (const auto& level : levels) {
+      levelsJson.push_back(json::array(
+          {std::format("{:.{}f}", level.price, PRICE_PRINT_PRECISION),
+           std::format("{:.{}f}", level.size, SIZE_PRINT_PRECISION)}));
+    }
+  };
+  priceLevelSetter(orderBookSnapshot.bids, snapshotJson.at("bids"));
+  priceLevelSetter(orderBookSnapshot.asks, snapshotJson.at("asks"));
+  if (orderBookSnapshot.checksum) {
+    // of the book's top levels, independent of the depth served
+    snapshotJson["checksum"] = *orderBookSnapshot.checksum;
+  }
+  return snapshotJson.dump();
+}
+
+std::string JsonUtils::bucketedSnapshotToJson(
+    const BucketedSnapshot& bucketedSnapshot) {
+  using namespace nlohmann;
+  json snapshotJson = {
+      {"time", std::to_string(bucketedSnapshot.timestamp.count())},
+      {"sequence", std::to_string(bucketedSnapshot.sequence)},
+      {"bucket", std::format("{:.{}f}", bucketedSnapshot.bucketSize,
+                             PRICE_PRINT_PRECISION)},
+      {"bids", json::array()},
+      {"asks", json::array()}};
+  // [price, size, number of raw levels in the bucket]
+  auto bucketLevelSetter = [&](const BucketLevels& levels, json& levelsJson) {
+    for (const auto& level : levels) {
+      levelsJson.push_back(json::array(
+          {std::format("{:.{}f}", level.price, PRICE_PRINT_PRECISION),
+           std::format("{:.{}f}", level.size, SIZE_PRINT_PRECISION),
+           std::to_string(level.levelCount)}));
+    }
+  };
+  bucketLevelSetter(bucketedSnapshot.bids, snapshotJson.at("bids"));
+  bucketLevelSetter(bucketedSnapshot.asks, snapshotJson.at("asks"));
+  return snapshotJson.dump();
+}
+
+std::string JsonUtils::orderCountSnapshotToJson(
+    const OrderCountSnapshot& orderCountSnapshot) {
+  using namespace nlohmann;
+  json snapshotJson = {
+      {"time", std::to_string(orderCountSnapshot.timestamp.count())},
+      {"sequence", std::to_string(orderCountSnapshot.sequence)},
+      {"bids", json::array()},
+      {"asks", json::array()}};
+  // [price, size, number of orders at the level]
+  auto levelSetter = [&](const OrderCountLevels& levels, json& levelsJson) {
+    for (const auto& level : levels) {
+      levelsJson.push_back(json::array(
+          {std::format("{:.{}f}", level.price, PRICE_PRINT_PRECISION),
+           std::format("{:.{}f}", level.size, SIZE_PRINT_PRECISION),
+           std::to_string(level.orderCount)}));
+    }
+  };
+  levelSetter(orderCountSnapshot.bids, snapshotJson.at("bids"));
+  levelSetter(orderCountSnapshot.asks, snapshotJson.at("asks"));
+  return snapshotJson.dump();
+}
+
+std::string JsonUtils::queuePositionToJson(
+    const QueuePosition& queuePosition) {
+  using namespace nlohmann;
+  auto formatSize = [](SizeType size) {
+    return std::format("{:.{}f}", size, SIZE_PRINT_PRECISION);
+  };
+  json positionJson = {
+      {"sequence", std::to_string(queuePosition.sequence)},
+      {"orderId", std::to_string(queuePosition.orderId)},
+      {"side", queuePosition.side == BidOrAsk::BID ? "bid" : "ask"},
+      {"price",
+       std::format("{:.{}f}", queuePosition.price, PRICE_PRINT_PRECISION)},
+      {"size", formatSize(queuePosition.size)},
+      {"ordersAhead", queuePosition.ordersAhead},
+      {"sizeAhead", formatSize(queuePosition.sizeAhead)},
+      {"levelOrderCount", queuePosition.levelOrderCount},
+      {"levelSize", formatSize(queuePosition.levelSize)}};
+  return positionJson.dump();
+}
+
+std::string JsonUtils::topOfBookToJson(const TopOfBook& topOfBook) {
+  using namespace nlohmann;
+  // [price, size], empty for a side without levels
+  auto sideJson = [](PriceType price, SizeType size) {
+    if (sizeCompareEqual(size, 0)) {
+      return json::array();
+    }
+    return json::array({std::format("{:.{}f}", price, PRICE_PRINT_PRECISION),
+                        std::format("{:.{}f}", size, SIZE_PRINT_PRECISION)});
+  };
+  json topOfBookJson = {
+      {"time", std::to_string(topOfBook.timestamp.count())},
+      {"receiveTime", std::to_string(topOfBook.receiveTimestamp.count())},
+      {"sequence", std::to_string(topOfBook.sequence)},
+      {"bid", sideJson(topOfBook.bidPrice, topOfBook.bidSize)},
+      {"ask", sideJson(topOfBook.askPrice, topOfBook.askSize)}};
+  return topOfBookJson.dump();
+}
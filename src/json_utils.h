@@ -8,9 +8,18 @@ class OrderBook;
 
 class JsonUtils {
  public:
-  static void populatePriceLevels(Levels& levels,
-                                  const nlohmann::json& jsonLevels,
-                                  bool withSequence = false);
-
   static std::string orderBookSnapshotToJson(const OrderBook& orderBook);
+
+  static std::string orderBookSnapshotToJson(
+      const OrderBookSnapshot& orderBookSnapshot);
+
+  static std::string bucketedSnapshotToJson(
+      const BucketedSnapshot& bucketedSnapshot);
+
+  static std::string orderCountSnapshotToJson(
+      const OrderCountSnapshot& orderCountSnapshot);
+
+  static std::string queuePositionToJson(const QueuePosition& queuePosition);
+
+  static std::string topOfBookToJson(const TopOfBook& topOfBook);
 };
@@ -1,9 +1,12 @@
 #include <boost/program_options.hpp>
 #include <filesystem>
+#include <format>
 #include <iostream>
+#include <memory>
 #include <ranges>
 #include <string>
 #include <thread>
+#include <vector>
 
 #include "OrderBookHTTPServer.h"
 #include "OrderBookNetworkConnector.h"
@@ -21,6 +24,15 @@ int main(int argc, char* argv[]) {
          "Hostname of OrderBook Feed Server or Simulation")  //
         ("port", po::value<std::string>()->default_value("40000"),
          "Port nuumber of OrderBook Feed Server or Simulation")  //
+        ("feed", po::value<std::string>()->default_value("kucoin"),
+         "Message schema of the feed: kucoin, binance, binance-futures or "
+         "kucoin-l3 (order level feed of FeedSimulator --l3, served as "
+         "levels plus orders.api and queue.api).")  //
+        ("symbol", po::value<std::string>()->default_value(""),
+         "Symbol to subscribe to, in the feed's own notation, empty uses "
+         "the feed's default (BTC-USDT for kucoin, BTCUSDT for binance). "
+         "A comma separated list gives every symbol its own feed connection "
+         "and feed thread, api requests pick one with symbol=<symbol>.")  //
         ("reconnect_delay", po::value<int>()->default_value(2000),
          "Delay in milliseconds before reconnect to OrderBook Feed Server or "
          "Simulation "
@@ -31,9 +43,75 @@ int main(int argc, char* argv[]) {
         ("http_server_port", po::value<int>()->default_value(48080),
          "Optional, use as http server port to server OrderBook, "
          "if 0 value is provided then it will not start as http server.")  //
+        ("http_server_socket", po::value<std::string>()->default_value(""),
+         "Optional, Unix domain socket the http server listens on instead of "
+         "http_server_host:http_server_port, OrderBookGateway talks to its "
+         "workers this way.")  //
         ("http_doc_dir",
          po::value<std::string>()->default_value("../order_booker_web_content"),
-         "Top dir path to be used for serveing files over http.");
+         "Top dir path to be used for serveing files over http.")  //
+        ("price_buckets",
+         po::value<std::string>()->default_value("0.1,1,10,100"),
+         "Comma separated bucket sizes of aggregated price views maintained "
+         "by the book and served at buckets.api?bucket=<size>, empty value "
+         "disables them.")  //
+        ("ws_batching", po::bool_switch()->default_value(false),
+         "Apply websocket frames that are already waiting in the socket as "
+         "one batch under a single lock, keeps the book from falling behind "
+         "during bursts.")  //
+        ("ws_batch_max_frames", po::value<std::size_t>()->default_value(256),
+         "Upper bound of frames applied in one batch when ws_batching is "
+         "on.")  //
+        ("ws_conflate", po::bool_switch()->default_value(false),
+         "With ws_batching, merge contiguous updates of a batch into the net "
+         "change per price before applying them to the book.")  //
+        ("ws_deflate", po::bool_switch()->default_value(false),
+         "Offer permessage-deflate on the feed websocket, trades CPU for "
+         "5-10x less bandwidth on json depth feeds.")  //
+        ("ws_deflate_window_bits", po::value<int>()->default_value(15),
+         "With ws_deflate, largest compression window (9..15 bits) the "
+         "server may use, smaller needs less memory per connection but "
+         "compresses worse.")  //
+        ("ws_deflate_no_context_takeover",
+         po::bool_switch()->default_value(false),
+         "With ws_deflate, ask the server to compress every message on its "
+         "own, costs ratio but keeps no compression state across "
+         "messages.")  //
+        ("ws_read_stats_interval", po::value<int>()->default_value(0),
+         "Milliseconds between websocket read statistics: wire and payload "
+         "bytes and the CPU spent reading (and inflating) a message, 0 "
+         "disables them.")  //
+        ("checksum_depth", po::value<int>()->default_value(25),
+         "Levels per side covered by the book's CRC32 checksum, verified "
+         "against the feed's checksum where it publishes one (a mismatch "
+         "resynchronizes) and served by snapshot.api, 0 disables it.")  //
+        ("history_dir", po::value<std::string>()->default_value(""),
+         "Optional, record applied updates and periodic book checkpoints to "
+         "memory mapped files in this directory, past states are served at "
+         "history.api?sequence=<n> or history.api?time=<ms> and by "
+         "OrderBookReplay.")  //
+        ("history_checkpoint_interval", po::value<int>()->default_value(1000),
+         "Milliseconds of exchange time between book checkpoints written to "
+         "history_dir, bounds the number of updates replayed per query.")  //
+        ("book_image", po::value<std::string>()->default_value(""),
+         "Optional, memory mapped file the book is saved to periodically and "
+         "on SIGINT/SIGTERM; on startup it is restored and goes live without "
+         "a snapshot when the feed continues its sequence.")  //
+        ("book_image_interval", po::value<int>()->default_value(1000),
+         "Milliseconds between saves of book_image.")  //
+        ("feed_cpu", po::value<int>()->default_value(-1),
+         "Optional, pin the feed thread (websocket, book updates) to this "
+         "cpu, ideally an isolated one, -1 leaves it unpinned.")  //
+        ("feed_busy_poll", po::bool_switch()->default_value(false),
+         "Spin the feed thread on io_context::poll() instead of sleeping in "
+         "epoll, trades a whole core for lower and tighter wire to book "
+         "latency, use together with feed_cpu.")  //
+        ("socket_busy_poll", po::value<int>()->default_value(50),
+         "With feed_busy_poll, SO_BUSY_POLL microseconds set on the "
+         "websocket where the kernel supports it, 0 leaves it unset.")  //
+        ("http_server_cpu", po::value<int>()->default_value(-1),
+         "Optional, pin the http server thread to this cpu, -1 leaves it "
+         "unpinned.");
 
     po::variables_map vm;
     po::store(po::parse_command_line(argc, argv, desc), vm);
@@ -73,25 +151,186 @@ int main(int argc, char* argv[]) {
     auto host = vm["host"].as<std::string>();
     auto port = vm["port"].as<std::string>();
     auto httpDocDir = vm["http_doc_dir"].as<std::string>();
+    auto feedAdapter = makeFeedAdapter(vm["feed"].as<std::string>());
 
-    bool runAsHTTPServer = httpServerPort > 0;
+    std::vector<PriceType> bucketSizes;
+    for (auto bucket :
+         vm["price_buckets"].as<std::string>() | std::views::split(',')) {
+      std::string bucketString(std::begin(bucket), std::end(bucket));
+      if (bucketString.empty()) {
+        continue;
+      }
+      auto bucketSize = std::stod(bucketString);
+      if (bucketSize <= 0) {
+        LOG_ERROR(std::format("price bucket {} must be greater than 0",
+                              bucketString));
+        std::cout << desc << std::endl;
+        return 1;
+      }
+      bucketSizes.push_back(bucketSize);
+    }
+
+    std::vector<std::string> symbols;
+    for (auto symbol :
+         vm["symbol"].as<std::string>() | std::views::split(',')) {
+      symbols.emplace_back(std::begin(symbol), std::end(symbol));
+    }
+    if (symbols.empty()) {
+      // the feed's default symbol
+      symbols.emplace_back();
+    }
+
+    auto httpServerSocket = vm["http_server_socket"].as<std::string>();
+    bool runAsHTTPServer = httpServerPort > 0 || !httpServerSocket.empty();
     bool useLock = runAsHTTPServer;
 
     std::filesystem::path currentPath = std::filesystem::current_path();
     // Print the current working directory
     LOG_INFO("Running from working directory: " << currentPath);
 
-    OrderBookNetworkConnector orderBookNetworkConnector(
-        host, port, reconnectDelay, useLock);
+    UpdateBatchingOptions updateBatchingOptions{
+        .enabled = vm["ws_batching"].as<bool>(),
+        .maxFrames = vm["ws_batch_max_frames"].as<std::size_t>(),
+        .conflate = vm["ws_conflate"].as<bool>()};
+    if (updateBatchingOptions.enabled && updateBatchingOptions.maxFrames < 1) {
+      LOG_ERROR("ws_batch_max_frames must be at least 1");
+      std::cout << desc << std::endl;
+      return 1;
+    }
+
+    FeedCompressionOptions feedCompressionOptions{
+        .deflate = vm["ws_deflate"].as<bool>(),
+        .windowBits = vm["ws_deflate_window_bits"].as<int>(),
+        .noContextTakeover = vm["ws_deflate_no_context_takeover"].as<bool>(),
+        .statsInterval =
+            std::chrono::milliseconds(vm["ws_read_stats_interval"].as<int>())};
+    // zlib can't inflate 8 bit windows reliably, beast rejects them too
+    if (feedCompressionOptions.windowBits < 9 ||
+        feedCompressionOptions.windowBits > 15) {
+      LOG_ERROR(std::format("ws_deflate_window_bits is {}, must be 9..15",
+                            feedCompressionOptions.windowBits));
+      std::cout << desc << std::endl;
+      return 1;
+    }
+    if (feedCompressionOptions.statsInterval.count() < 0) {
+      LOG_ERROR("ws_read_stats_interval must not be negative");
+      std::cout << desc << std::endl;
+      return 1;
+    }
+
+    auto checksumDepth = vm["checksum_depth"].as<int>();
+    if (checksumDepth < 0) {
+      LOG_ERROR("checksum_depth must not be negative");
+      std::cout << desc << std::endl;
+      return 1;
+    }
+
+    FeedThreadOptions feedThreadOptions{
+        .cpu = vm["feed_cpu"].as<int>(),
+        .busyPoll = vm["feed_busy_poll"].as<bool>(),
+        .socketBusyPollMicros = vm["feed_busy_poll"].as<bool>()
+                                    ? vm["socket_busy_poll"].as<int>()
+                                    : 0};
+    auto httpServerCpu = vm["http_server_cpu"].as<int>();
+    int cpuCount = static_cast<int>(std::thread::hardware_concurrency());
+    for (auto cpu : {feedThreadOptions.cpu, httpServerCpu}) {
+      if (cpu < -1 || (cpuCount > 0 && cpu >= cpuCount)) {
+        LOG_ERROR(std::format("cpu {} is out of range, {} cpus available",
+                              cpu, cpuCount));
+        std::cout << desc << std::endl;
+        return 1;
+      }
+    }
+    if (feedThreadOptions.cpu >= 0 && std::size(symbols) > 1) {
+      LOG_ERROR("feed_cpu pins a single feed thread, it can't be combined "
+                "with several symbols");
+      std::cout << desc << std::endl;
+      return 1;
+    }
+    if (feedThreadOptions.cpu >= 0 && feedThreadOptions.cpu == httpServerCpu) {
+      LOG_ERROR("feed_cpu and http_server_cpu must be different cpus");
+      std::cout << desc << std::endl;
+      return 1;
+    }
+    if (feedThreadOptions.socketBusyPollMicros < 0) {
+      LOG_ERROR("socket_busy_poll must not be negative");
+      std::cout << desc << std::endl;
+      return 1;
+    }
+    auto cpuName = [](int cpu) {
+      return cpu < 0 ? std::string("any cpu") : std::format("cpu {}", cpu);
+    };
+    LOG_INFO(std::format(
+        "Threading: feed thread on {}, {}, SO_BUSY_POLL {}; http server "
+        "thread {}; {} cpus available",
+        cpuName(feedThreadOptions.cpu),
+        feedThreadOptions.busyPoll ? "busy polling" : "blocking in epoll",
+        feedThreadOptions.socketBusyPollMicros > 0
+            ? std::format("{} us", feedThreadOptions.socketBusyPollMicros)
+            : std::string("off"),
+        runAsHTTPServer ? "on " + cpuName(httpServerCpu) : "not started",
+        cpuCount));
+    if (feedThreadOptions.busyPoll && feedThreadOptions.cpu < 0) {
+      LOG_WARN("feed_busy_poll without feed_cpu spins on whichever cpu the "
+               "scheduler picks");
+    }
+
+    // several symbols keep their history and image apart by symbol
+    bool severalSymbols = std::size(symbols) > 1;
+    auto historyDir = vm["history_dir"].as<std::string>();
+    auto checkpointInterval = vm["history_checkpoint_interval"].as<int>();
+    if (!historyDir.empty() && checkpointInterval < 1) {
+      LOG_ERROR("history_checkpoint_interval must be at least 1");
+      std::cout << desc << std::endl;
+      return 1;
+    }
+    auto bookImage = vm["book_image"].as<std::string>();
+    auto bookImageInterval = vm["book_image_interval"].as<int>();
+    if (!bookImage.empty() && bookImageInterval < 1) {
+      LOG_ERROR("book_image_interval must be at least 1");
+      std::cout << desc << std::endl;
+      return 1;
+    }
+
+    std::vector<std::unique_ptr<OrderBookNetworkConnector>> connectors;
+    for (const auto& symbol : symbols) {
+      auto& connector =
+          connectors.emplace_back(std::make_unique<OrderBookNetworkConnector>(
+              host, port, reconnectDelay, useLock, bucketSizes,
+              updateBatchingOptions, feedThreadOptions, feedAdapter, symbol,
+              feedCompressionOptions, static_cast<std::size_t>(checksumDepth)));
+      if (!historyDir.empty()) {
+        connector->enableHistory(
+            severalSymbols
+                ? (std::filesystem::path(historyDir) / symbol).string()
+                : historyDir,
+            std::chrono::milliseconds(checkpointInterval));
+      }
+      if (!bookImage.empty()) {
+        connector->enableBookImage(
+            severalSymbols ? std::format("{}.{}", bookImage, symbol)
+                           : bookImage,
+            std::chrono::milliseconds(bookImageInterval));
+      }
+    }
 
     std::jthread httpServerThread;  // not started yet
     std::unique_ptr<OrderBookHTTPServer> m_orderBookHTTPServer;
     if (runAsHTTPServer) {
       m_orderBookHTTPServer = std::make_unique<OrderBookHTTPServer>(
-          [&]() {
+          [&](const SnapshotQuery& snapshotQuery) {
             // callback hit by http server to get snapshot
             try {
-              return orderBookNetworkConnector.getSnapshot();
+              if (snapshotQuery.symbol.empty()) {
+                return connectors.front()->getSnapshot(snapshotQuery);
+              }
+              for (const auto& connector : connectors) {
+                if (connector->getSymbol() == snapshotQuery.symbol) {
+                  return connector->getSnapshot(snapshotQuery);
+                }
+              }
+              throw std::runtime_error(std::format(
+                  "symbol {} is not served", snapshotQuery.symbol));
             } catch (const std::exception& exp) {
               LOG_ERROR(
                   "Exception occured while generating snapshot for http "
@@ -100,11 +339,33 @@ int main(int argc, char* argv[]) {
               throw;
             }
           },
-          vm["http_server_host"].as<std::string>(),
+          httpServerSocket.empty() ? vm["http_server_host"].as<std::string>()
+                                   : "unix:" + httpServerSocket,
           std::to_string(httpServerPort), httpDocDir);
-      httpServerThread = std::jthread([&]() { m_orderBookHTTPServer->run(); });
+      httpServerThread = std::jthread([&]() {
+        try {
+          if (httpServerCpu >= 0) {
+            pinCurrentThread(httpServerCpu);
+          }
+        } catch (const std::exception& exp) {
+          LOG_ERROR(exp.what() << ", http server thread stays unpinned");
+        }
+        m_orderBookHTTPServer->run();
+      });
+    }
+    // one feed thread per symbol, the first one runs on this thread
+    std::vector<std::jthread> feedThreads;
+    for (auto& connector : connectors | std::views::drop(1)) {
+      feedThreads.emplace_back([&connector]() {
+        try {
+          connector->run();
+        } catch (const std::exception& exp) {
+          LOG_ERROR("Feed of " << connector->getSymbol()
+                               << " stopped: " << exp.what());
+        }
+      });
     }
-    orderBookNetworkConnector.run();
+    connectors.front()->run();
   } catch (const std::exception& exp) {
     std::cout << "exception occured: " << exp.what() << std::endl;
     return 1;
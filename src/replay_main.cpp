@@ -0,0 +1,73 @@
+#include <boost/program_options.hpp>
+#include <chrono>
+#include <iostream>
+#include <string>
+
+#include "BookHistory.h"
+#include "OrderBook.hpp"
+#include "json_utils.h"
+#include "logging.h"
+
+namespace po = boost::program_options;
+
+// Rebuilds the book recorded with OrderBook --history_dir at a sequence or
+// timestamp and prints it in the snapshot.api format.
+int main(int argc, char* argv[]) {
+  try {
+    po::options_description desc("Allowed options");
+    desc.add_options()                    //
+        ("help", "produce help message")  //
+        ("history_dir", po::value<std::string>()->required(),
+         "Directory the OrderBook process recorded its history to")  //
+        ("sequence", po::value<SequenceType>(),
+         "Rebuild the book right after the last update ending at or before "
+         "this sequence")  //
+        ("time", po::value<long>(),
+         "Rebuild the book right after the last update stamped at or before "
+         "this time, milliseconds since epoch")  //
+        ("depth", po::value<std::size_t>()->default_value(0),
+         "Number of levels to print per side, 0 prints full depth");
+
+    po::variables_map vm;
+    po::store(po::parse_command_line(argc, argv, desc), vm);
+
+    if (vm.count("help")) {
+      std::cout << desc << std::endl;
+      return 1;
+    }
+    po::notify(vm);
+
+    if (vm.count("sequence") == vm.count("time")) {
+      LOG_ERROR("Exactly one of sequence or time must be given");
+      std::cout << desc << std::endl;
+      return 1;
+    }
+
+    auto startTime = std::chrono::steady_clock::now();
+    BookHistoryReader bookHistoryReader(vm["history_dir"].as<std::string>());
+    auto orderBook =
+        vm.count("sequence")
+            ? bookHistoryReader.rebuildAtSequence(
+                  vm["sequence"].as<SequenceType>())
+            : bookHistoryReader.rebuildAtTimestamp(
+                  TimePoint(vm["time"].as<long>()));
+    auto rebuildTime = std::chrono::steady_clock::now() - startTime;
+
+    OrderBookSnapshot orderBookSnapshot{
+        .sequence = orderBook.getSequence(),
+        .timestamp = orderBook.getLastUpdateTimestamp()};
+    orderBook.getLevels(vm["depth"].as<std::size_t>(), orderBookSnapshot.bids,
+                        orderBookSnapshot.asks);
+    std::cout << JsonUtils::orderBookSnapshotToJson(orderBookSnapshot)
+              << std::endl;
+    std::cerr << "rebuilt in "
+              << std::chrono::duration_cast<std::chrono::microseconds>(
+                     rebuildTime)
+                     .count()
+              << " us" << std::endl;
+  } catch (const std::exception& exp) {
+    std::cout << "exception occured: " << exp.what() << std::endl;
+    return 1;
+  }
+  return 0;
+}
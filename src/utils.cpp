@@ -1,7 +1,18 @@
 
 #include "utils.h"
 
+#include <pthread.h>
+#include <sched.h>
+#include <sys/socket.h>
+#include <time.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
 #include <cmath>
+#include <cstring>
+#include <format>
+#include <stdexcept>
 
 bool doubleCompareEqual(const SizeType& lhs, const SizeType& rhs,
                         double tolerance) {
@@ -54,6 +65,61 @@ bool sizeCompareLessThan(const SizeType& lhs, const SizeType& rhs) {
   return lhs < rhs;
 }
 
+bool caseInsensitiveEqual(std::string_view lhs, std::string_view rhs) {
+  return std::ranges::equal(lhs, rhs, [](unsigned char lhs, unsigned char rhs) {
+    return std::tolower(lhs) == std::tolower(rhs);
+  });
+}
+
+std::string_view getQueryParameter(std::string_view uri,
+                                   std::string_view name) {
+  auto queryStart = uri.find('?');
+  if (queryStart == std::string_view::npos) {
+    return {};
+  }
+  auto query = uri.substr(queryStart + 1);
+  while (!query.empty()) {
+    auto parameter = query.substr(0, query.find('&'));
+    query.remove_prefix(std::min(std::size(parameter) + 1, std::size(query)));
+    auto equalPos = parameter.find('=');
+    if (parameter.substr(0, equalPos) == name) {
+      return equalPos == std::string_view::npos
+                 ? std::string_view{}
+                 : parameter.substr(equalPos + 1);
+    }
+  }
+  return {};
+}
+
+void pinCurrentThread(int cpu) {
+  cpu_set_t cpuSet;
+  CPU_ZERO(&cpuSet);
+  CPU_SET(cpu, &cpuSet);
+  if (auto error =
+          pthread_setaffinity_np(pthread_self(), sizeof(cpuSet), &cpuSet);
+      error != 0) {
+    throw std::runtime_error(std::format("Cannot pin thread to cpu {}: {}",
+                                         cpu, std::strerror(error)));
+  }
+}
+
+bool setSocketBusyPoll(int socket, int micros) {
+#if defined(SO_BUSY_POLL)
+  return setsockopt(socket, SOL_SOCKET, SO_BUSY_POLL, &micros,
+                    sizeof(micros)) == 0;
+#else
+  errno = ENOPROTOOPT;
+  return false;
+#endif  // defined(SO_BUSY_POLL)
+}
+
+std::chrono::nanoseconds getThreadCpuTime() {
+  timespec cpuTime{};
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpuTime);
+  return std::chrono::seconds(cpuTime.tv_sec) +
+         std::chrono::nanoseconds(cpuTime.tv_nsec);
+}
+
 bool PriceCompareLessThan::operator()(const PriceType& lhs,
                                       const PriceType& rhs) const {
   return priceCompareLessThan(lhs, rhs);
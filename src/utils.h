@@ -2,6 +2,7 @@
 
 #include <chrono>
 #include <limits>
+#include <string_view>
 
 #include "common_header.h"
 
@@ -14,6 +15,17 @@ bool sizeCompareEqual(const SizeType& lhs, const SizeType& rhs);
 bool priceCompareLessThan(const SizeType& lhs, const SizeType& rhs);
 bool priceCompareGreaterThan(const SizeType& lhs, const SizeType& rhs);
 bool sizeCompareLessThan(const SizeType& lhs, const SizeType& rhs);
+bool caseInsensitiveEqual(std::string_view lhs, std::string_view rhs);
+// Value of `name` in the query string of `uri`, empty if not present.
+std::string_view getQueryParameter(std::string_view uri,
+                                   std::string_view name);
+// Restricts the calling thread to `cpu`, throws when the kernel refuses.
+void pinCurrentThread(int cpu);
+// Sets SO_BUSY_POLL on `socket`, returns false (errno set) when the option is
+// not supported or not permitted.
+bool setSocketBusyPoll(int socket, int micros);
+// CPU time consumed by the calling thread so far.
+std::chrono::nanoseconds getThreadCpuTime();
 
 std::string httpGet(std::string_view host, std::string_view port,
                     std::string_view uri);
@@ -18,7 +18,7 @@
 namespace http {
 namespace server {
 
-connection::connection(boost::asio::ip::tcp::socket socket,
+connection::connection(boost::asio::generic::stream_protocol::socket socket,
                        connection_manager& manager, request_handler& handler)
     : socket_(std::move(socket)),
       connection_manager_(manager),
@@ -62,7 +62,7 @@ void connection::do_write() {
         if (!ec) {
           // Initiate graceful connection closure.
           boost::system::error_code ignored_ec;
-          socket_.shutdown(boost::asio::ip::tcp::socket::shutdown_both,
+          socket_.shutdown(boost::asio::socket_base::shutdown_both,
                            ignored_ec);
         }
 
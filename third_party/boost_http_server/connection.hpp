@@ -32,7 +32,7 @@ class connection : public std::enable_shared_from_this<connection> {
   connection& operator=(const connection&) = delete;
 
   /// Construct a connection with the given socket.
-  explicit connection(boost::asio::ip::tcp::socket socket,
+  explicit connection(boost::asio::generic::stream_protocol::socket socket,
                       connection_manager& manager, request_handler& handler);
 
   /// Start the first asynchronous operation for the connection.
@@ -48,8 +48,8 @@ class connection : public std::enable_shared_from_this<connection> {
   /// Perform an asynchronous write operation.
   void do_write();
 
-  /// Socket for the connection.
-  boost::asio::ip::tcp::socket socket_;
+  /// Socket for the connection, TCP or Unix domain.
+  boost::asio::generic::stream_protocol::socket socket_;
 
   /// The manager for this connection.
   connection_manager& connection_manager_;
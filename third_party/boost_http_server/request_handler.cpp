@@ -27,9 +27,9 @@ request_handler::request_handler(const std::string& doc_root,
     : doc_root_(doc_root), m_requestHandler{requestHandler} {}
 
 void request_handler::handle_request(const request& req, reply& rep) {
-  // Decode url to path.
+  // Decode url to path, the query string (if any) is left to the api handler.
   std::string request_path;
-  if (!url_decode(req.uri, request_path)) {
+  if (!url_decode(req.uri.substr(0, req.uri.find('?')), request_path)) {
     rep = reply::stock_reply(reply::bad_request);
     return;
   }
@@ -61,7 +61,20 @@ void request_handler::handle_request(const request& req, reply& rep) {
   if (extension == "api") {
     try {
       // std::cout << "serving api " << request_path << std::endl;
+      rep.status = reply::ok;
+      rep.headers.clear();
+      rep.content.clear();
       const std::string json = m_requestHandler(request_path, req, rep);
+      if (rep.status == reply::not_modified) {
+        // api handler decided client copy is current, headers set by handler
+        rep.headers.push_back({"Content-Length", "0"});
+        return;
+      }
+      if (rep.status != reply::ok) {
+        // api handler reported an error other than a missing resource
+        rep = reply::stock_reply(rep.status);
+        return;
+      }
       rep.content.append(json.c_str(), json.size());
       extension = "json";
     } catch (...) {
@@ -83,11 +96,10 @@ void request_handler::handle_request(const request& req, reply& rep) {
   }
 
   rep.status = reply::ok;
-  rep.headers.resize(2);
-  rep.headers[0].name = "Content-Length";
-  rep.headers[0].value = std::to_string(rep.content.size());
-  rep.headers[1].name = "Content-Type";
-  rep.headers[1].value = mime_types::extension_to_type(extension);
+  // api handlers may already have added headers (e.g. ETag)
+  rep.headers.push_back({"Content-Length", std::to_string(rep.content.size())});
+  rep.headers.push_back(
+      {"Content-Type", mime_types::extension_to_type(extension)});
 }
 
 bool request_handler::url_decode(const std::string& in, std::string& out) {
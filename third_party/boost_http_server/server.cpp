@@ -11,6 +11,7 @@
 #include "server.hpp"
 
 #include <signal.h>
+#include <unistd.h>
 
 #include <utility>
 
@@ -45,11 +46,22 @@ server::server(const std::string& address, const std::string& port,
   // // boost::asio::ip::tcp::endpoint endpoint =
   // //     *resolver.resolve(address, port).begin();
 
-  boost::asio::ip::tcp::endpoint endpoint =
-      *resolver.resolve(address, port).begin();
-  acceptor_.open(endpoint.protocol());
-  acceptor_.set_option(boost::asio::ip::tcp::acceptor::reuse_address(true));
-  acceptor_.bind(endpoint);
+  const std::string unix_prefix = "unix:";
+  if (address.starts_with(unix_prefix)) {
+    auto path = address.substr(unix_prefix.size());
+    // a socket file left behind by a previous run would fail the bind
+    ::unlink(path.c_str());
+    boost::asio::generic::stream_protocol::endpoint endpoint{
+        boost::asio::local::stream_protocol::endpoint(path)};
+    acceptor_.open(endpoint.protocol());
+    acceptor_.bind(endpoint);
+  } else {
+    boost::asio::generic::stream_protocol::endpoint endpoint(
+        resolver.resolve(address, port).begin()->endpoint());
+    acceptor_.open(endpoint.protocol());
+    acceptor_.set_option(boost::asio::socket_base::reuse_address(true));
+    acceptor_.bind(endpoint);
+  }
   acceptor_.listen();
 
   do_accept();
@@ -64,8 +76,10 @@ void server::run() {
 }
 
 void server::do_accept() {
-  acceptor_.async_accept([this](boost::system::error_code ec,
-                                boost::asio::ip::tcp::socket socket) {
+  acceptor_.async_accept([this](
+                             boost::system::error_code ec,
+                             boost::asio::generic::stream_protocol::socket
+                                 socket) {
     // Check whether the server was stopped by a signal before this
     // completion handler had a chance to run.
     if (!acceptor_.is_open()) {
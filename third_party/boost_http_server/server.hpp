@@ -28,7 +28,9 @@ class server {
   server& operator=(const server&) = delete;
 
   /// Construct the server to listen on the specified TCP address and port, and
-  /// serve up files from the given directory.
+  /// serve up files from the given directory. An address of the form
+  /// "unix:<path>" listens on a Unix domain socket at <path> instead and
+  /// ignores the port.
   explicit server(const std::string& address, const std::string& port,
                   const std::string& doc_root,
                   HttpRequestHandler requestHandler);
@@ -50,7 +52,8 @@ class server {
   boost::asio::signal_set signals_;
 
   /// Acceptor used to listen for incoming connections.
-  boost::asio::ip::tcp::acceptor acceptor_;
+  boost::asio::basic_socket_acceptor<boost::asio::generic::stream_protocol>
+      acceptor_;
 
   /// The connection manager which owns all live connections.
   connection_manager connection_manager_;